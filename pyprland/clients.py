@@ -0,0 +1,89 @@
+"""Index of the compositor clients (windows), shared by the plugins.
+
+It's filled with a single `clients` query the first time it's needed,
+then kept up to date by the daemon using the window events (the ones received
+while the query is pending are applied once it's done).
+"""
+import asyncio
+from dataclasses import dataclass
+from typing import Iterator
+
+from .events import Event
+from .ipc import Transport
+
+
+@dataclass
+class Client:
+    address: str
+    "Window address, without the 0x prefix"
+    klass: str
+    title: str
+    workspace: str
+    "Workspace name"
+
+
+class ClientIndex:
+    def __init__(self):
+        self.clients: dict[str, Client] = {}
+        self.filled = False
+        self._filling: asyncio.Future | None = None
+        # events received while the clients query is pending, applied once filled
+        self._pending: list[Event] = []
+
+    def __len__(self) -> int:
+        return len(self.clients)
+
+    def __iter__(self) -> Iterator[Client]:
+        return iter(list(self.clients.values()))
+
+    def get(self, address: str) -> Client | None:
+        return self.clients.get(address)
+
+    async def ensure(self, ipc: Transport) -> None:
+        "Fills the index if it's not done yet"
+        if self.filled:
+            return
+        if self._filling is not None:  # already being filled by another task
+            await asyncio.shield(self._filling)
+            return await self.ensure(ipc)
+        self._filling = asyncio.get_running_loop().create_future()
+        try:
+            self.clients = {
+                c["address"][2:]: Client(
+                    c["address"][2:],
+                    c["class"],
+                    c["title"],
+                    c["workspace"]["name"],
+                )
+                for c in await ipc.hyprctlJSON("clients")
+            }
+            self.filled = True
+            for event in self._pending:
+                self.update(event)
+        finally:
+            self._pending = []
+            self._filling.set_result(None)
+            self._filling = None
+
+    def update(self, event: Event) -> None:
+        "Applies a (normalized) event"
+        if not self.filled:
+            if self._filling is not None:
+                self._pending.append(event)
+            return
+        name = event.name
+        if name == "openwindow":
+            self.clients[event.address] = Client(
+                event.address, event.klass, event.title, event.workspace_name
+            )
+            return
+        if name == "closewindow":
+            self.clients.pop(event.address, None)
+            return
+        client = self.clients.get(event.address)
+        if client is None:
+            return
+        if name == "movewindow":
+            client.workspace = event.workspace_name
+        elif name == "windowtitle" and event.title:
+            client.title = event.title
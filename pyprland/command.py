@@ -4,36 +4,101 @@ import json
 import sys
 import os
 import importlib
+import math
+import socket
+import stat
+import time
 import traceback
+from typing import Any
 
 
-from .ipc import get_event_stream
+from .clients import ClientIndex
+from .ipc import HYPR_DIR, Transport, default_transport
 from .common import DEBUG
+from .events import Event, EventNormalizer
+from .load import load_monitor
+from .locks import LockManager
 from .plugins.interface import Plugin
+from .state import StateFile
+from . import systemd
+from .timers import TimerService
+from .tracing import Span, tracer
 
-CONTROL = f'/tmp/hypr/{ os.environ["HYPRLAND_INSTANCE_SIGNATURE"] }/.pyprland.sock'
+CONTROL = os.path.join(HYPR_DIR, ".pyprland.sock")
 
 CONFIG_FILE = "~/.config/hypr/pyprland.json"
 
+PAIR_TIMEOUT = 0.01  # max delay between the two events of a pair
+
+CONNECT_RETRIES = 20  # every 100ms
+
+CONTROL_BACKLOG = 100  # connections queued while the daemon is busy or starting
+
+REPORT_MARKER = "?"  # prefix of the commands for which the client waits for a report
+
+
+def get_report(spans: list[Span]) -> dict[str, Any]:
+    """Summarizes the spans of a command, durations are in seconds"""
+    report = {"total": 0.0, "read": 0.0, "dispatch": 0.0, "ipc": 0.0, "wait": 0.0}
+    report.update(ipc_calls=0, handlers=0, errors=0)
+    for span in spans:
+        if span.cat == "ipc":
+            report["ipc"] += span.duration
+            report["ipc_calls"] += 1
+        elif span.cat == "wait":
+            report["wait"] += span.duration
+        elif span.cat == "handler":
+            report["dispatch"] += span.duration
+            report["handlers"] += 1
+        elif span.name == "read":
+            report["read"] = span.duration
+        elif span.name == "command":
+            report["total"] = span.duration
+        if "error" in span.args:
+            report["errors"] += 1
+    return report
+
+
+DEFAULT_TRACE_FILE = os.path.join(
+    os.environ.get("XDG_RUNTIME_DIR") or "/tmp", "pyprland-trace.json"
+)
+
 
 class Pyprland:
     server: asyncio.Server
     event_reader: asyncio.StreamReader
     stopped = False
     name = "builtin"
+    state_file: StateFile | None = None
 
-    def __init__(self):
+    def __init__(self, ipc: Transport = default_transport):
+        self.ipc = ipc
         self.plugins: dict[str, Plugin] = {}
+        self.timers = TimerService()
+        self.clients = ClientIndex()
+        self.locks = LockManager()
+        # plugin name => last queued event handler
+        self.queues: dict[str, asyncio.Task] = {}
+        self.focused_monitor = ""
+        self.active_workspaces: dict[str, str] = {}
+        self.workspaces: set[str] = set()
 
     async def load_config(self, init=True):
         self.config = json.loads(
             open(os.path.expanduser(CONFIG_FILE), encoding="utf-8").read()
         )
+        if init and not self.ipc.capabilities.version:
+            await self.ipc.capabilities.probe()
         for name in self.config["pyprland"]["plugins"]:
             if name not in self.plugins:
                 modname = name if "." in name else f"pyprland.plugins.{name}"
                 try:
                     plug = importlib.import_module(modname).Extension(name)
+                    plug.timers = self.timers
+                    plug.ipc = self.ipc
+                    plug.clients = self.clients
+                    plug.locks = self.locks
+                    plug.load = load_monitor
                     if init:
                         await plug.init()
                     self.plugins[name] = plug
@@ -43,40 +108,190 @@ class Pyprland:
                         traceback.print_exc()
             if init:
                 await self.plugins[name].load_config(self.config)
+        tracer.enabled = bool(self.config["pyprland"].get("tracing", DEBUG))
+        load_monitor.configure(self.config["pyprland"].get("load_thresholds", {}))
+        if init:
+            load_monitor.start(self.timers)
+        if init and self.config["pyprland"].get("state_file", False):
+            if self.state_file is None:
+                self.state_file = StateFile()
+            await self.sync_state()
+            self.publish_state()
+
+    async def sync_state(self):
+        """Fetches the compositor state tracked by the daemon."""
+        await self.sync_monitors()
+        self.workspaces = {w["name"] for w in await self.ipc.hyprctlJSON("workspaces")}
+
+    async def sync_monitors(self):
+        for mon in await self.ipc.hyprctlJSON("monitors"):
+            self.active_workspaces[mon["name"]] = mon["activeWorkspace"]["name"]
+            if mon["focused"]:
+                self.focused_monitor = mon["name"]
+
+    def get_state(self) -> dict[str, Any]:
+        return {
+            "focused_monitor": self.focused_monitor,
+            "active_workspaces": self.active_workspaces,
+            "workspaces": sorted(self.workspaces),
+        }
+
+    def publish_state(self):
+        if self.state_file is None:
+            return
+        state = {"pyprland": self.get_state()}
+        for name, plugin in self.plugins.items():
+            plugin_state = plugin.get_state()
+            if plugin_state is not None:
+                state[name] = plugin_state
+        try:
+            self.state_file.publish(state)
+        except OSError as e:
+            print(f"Can't write state file: {e}")
+
+    # Compositor state tracking (only used for the state file)
+
+    async def on_focusedmon(self, event: Event):
+        self.focused_monitor = event.monitor
+        self.active_workspaces[event.monitor] = event.workspace_name
+
+    async def on_workspace(self, event: Event):
+        if self.focused_monitor:
+            self.active_workspaces[self.focused_monitor] = event.workspace_name
+
+    async def on_createworkspace(self, event: Event):
+        self.workspaces.add(event.workspace_name)
+
+    async def on_destroyworkspace(self, event: Event):
+        self.workspaces.discard(event.workspace_name)
+
+    async def on_monitorremoved(self, event: Event):
+        self.active_workspaces.pop(event.monitor, None)
+
+    async def on_moveworkspace(self, event: Event):
+        # the active workspace of a monitor which isn't focused may change (eg: swapactiveworkspaces),
+        # the event doesn't say it: fetch the monitors once the moves are over
+        if self.state_file is not None:
+            self.timers.schedule(
+                "pyprland.sync_monitors", 0.05, self.resync_monitors, replace=False
+            )
+
+    async def resync_monitors(self):
+        await self.sync_monitors()
+        self.publish_state()
+
+    async def _runHandler(self, plugin, full_name, params) -> None:
+        try:
+            with tracer.span(f"{plugin.name}::{full_name}", "handler"):
+                await getattr(plugin, full_name)(*params)
+        except Exception as e:
+            print(f"{plugin.name}::{full_name}({params}) failed:")
+            traceback.print_exc()
 
     async def _callHandler(self, full_name, *params):
+        called = False
         for plugin in [self] + list(self.plugins.values()):
             if hasattr(plugin, full_name):
-                try:
-                    await getattr(plugin, full_name)(*params)
-                except Exception as e:
-                    print(f"{plugin.name}::{full_name}({params}) failed:")
-                    traceback.print_exc()
+                called = True
+                await self._runHandler(plugin, full_name, params)
+        if called:
+            self.publish_state()
+
+    async def _queueHandlers(self, full_name, *params):
+        """Runs the event handlers of the plugins concurrently, each plugin processing its events in order.
+        The daemon's own handlers run first and are awaited."""
+        if hasattr(self, full_name):
+            await self._runHandler(self, full_name, params)
+            self.publish_state()
+        for plugin in self.plugins.values():
+            if hasattr(plugin, full_name):
+                previous = self.queues.get(plugin.name)
+                task = asyncio.create_task(
+                    self._runQueued(previous, plugin, full_name, params)
+                )
+                self.queues[plugin.name] = task
+                task.add_done_callback(self._unqueue)
+
+    async def _runQueued(self, previous, plugin, full_name, params) -> None:
+        tracer.new_row()  # runs concurrently with the other plugins' handlers
+        if previous is not None:
+            await asyncio.wait([previous])
+        await self._runHandler(plugin, full_name, params)
+        self.publish_state()
+
+    def _unqueue(self, task: asyncio.Task) -> None:
+        for name, last in list(self.queues.items()):
+            if last is task:
+                del self.queues[name]
+
+    async def drain(self) -> None:
+        "Waits for the queued event handlers"
+        while self.queues:
+            await asyncio.wait(list(self.queues.values()))
+
+    async def dispatch_events(self, events: list[Event]):
+        for event in events:
+            self.clients.update(event)  # before the handlers, so they see the new state
+            full_name = f"on_{event.name}"
+            if DEBUG:
+                print(f"EVT {full_name}({event})")
+            with tracer.span(full_name, "event"):
+                await self._queueHandlers(full_name, event)
 
     async def read_events_loop(self):
+        normalizer = EventNormalizer()
         while not self.stopped:
-            data = (await self.event_reader.readline()).decode()
+            try:
+                # when the first event of a pair is pending, don't wait too long for the second one
+                data = await asyncio.wait_for(
+                    self.event_reader.readline(),
+                    PAIR_TIMEOUT if normalizer.pending else None,
+                )
+            except asyncio.TimeoutError:
+                await self.dispatch_events(normalizer.flush())
+                continue
             if not data:
                 print("Reader starved")
                 return
-            cmd, params = data.split(">>")
+            cmd, params = data.decode().split(">>", 1)
             full_name = f"event_{cmd}"
 
-            if DEBUG:
-                print(f"EVT {full_name}({params.strip()})")
-            await self._callHandler(full_name, params)
+            # raw events, for compatibility
+            with tracer.span(full_name, "event", params=params.strip()):
+                await self._queueHandlers(full_name, params)
+            await self.dispatch_events(normalizer.feed(cmd, params.rstrip("\n")))
 
     async def read_command(self, reader, writer) -> None:
-        data = (await reader.readline()).decode()
+        # spans are always collected, in case the client asks for a report
+        with tracer.collecting() as spans:
+            with tracer.span("command", "command") as span:
+                report = await self._read_command(reader, writer, span)
+        if report:
+            try:
+                writer.write((json.dumps(get_report(spans)) + "\n").encode())
+                await writer.drain()
+                writer.close()
+                await writer.wait_closed()
+            except ConnectionError:
+                pass
+
+    async def _read_command(self, reader, writer, span) -> bool:
+        """Runs the command, returns True if the client expects a report"""
+        with tracer.span("read", "command"):
+            data = (await reader.readline()).decode()
         if not data:
             print("Server starved")
-            return
+            return False
+        report = data.startswith(REPORT_MARKER)
+        if report:
+            data = data[len(REPORT_MARKER) :]
+        span.args["line"] = data.strip()
         if data == "exit\n":
             self.stopped = True
             writer.close()
             await writer.wait_closed()
             self.server.close()
-            return
+            return False
         args = data.split(None, 1)
         if len(args) == 1:
             cmd = args[0]
@@ -94,13 +309,17 @@ class Pyprland:
             print(f"CMD: {full_name}({args})")
 
         await self._callHandler(full_name, *args)
+        return report
 
     async def serve(self):
         try:
             async with self.server:
                 await self.server.serve_forever()
         finally:
+            await self.drain()
             await asyncio.gather(*(plugin.exit() for plugin in self.plugins.values()))
+            if self.state_file:
+                self.state_file.close()
 
     async def run(self):
         await asyncio.gather(
@@ -110,11 +329,56 @@ class Pyprland:
 
     run_reload = load_config
 
+    async def run_dump_trace(self, path=""):
+        """[path] Writes the recorded trace spans in the Chrome trace-event format"""
+        path = os.path.expanduser(path.strip() or DEFAULT_TRACE_FILE)
+        if not tracer.enabled:
+            print('Tracing is disabled, set "tracing": true in the pyprland section')
+        count = tracer.export(path)
+        print(f"{count} spans written to {path}")
+
+    async def run_timers(self):
+        """Prints the timers statistics and pending keys"""
+        print(self.timers.metrics())
+        for key in self.timers._timers:
+            print(f"  pending: {key}")
+
+    async def run_load(self):
+        """Prints the event loop lag and IPC round trip averages (seconds)"""
+        print(load_monitor.metrics())
+
+    async def run_locks(self):
+        """Prints the resource locks statistics and the queued event handlers"""
+        print(self.locks.metrics())
+        for name in self.queues:
+            print(f"  busy: {name}")
+
+
+def control_socket() -> socket.socket:
+    """Returns the listening control socket, passed by systemd or bound to CONTROL.
+    It listens before the server is started, so early clients are queued rather than refused.
+    """
+    activated_sockets = systemd.listen_fds()
+    if activated_sockets:
+        return activated_sockets[0]
+    try:
+        if stat.S_ISSOCK(os.stat(CONTROL).st_mode):
+            os.unlink(CONTROL)  # left by a previous run
+    except FileNotFoundError:
+        pass
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.bind(CONTROL)
+    sock.listen(CONTROL_BACKLOG)
+    return sock
+
 
 async def run_daemon():
     manager = Pyprland()
-    manager.server = await asyncio.start_unix_server(manager.read_command, CONTROL)
-    events_reader, events_writer = await get_event_stream()
+    # Commands received before the plugins are loaded wait in the socket backlog
+    manager.server = await asyncio.start_unix_server(
+        manager.read_command, sock=control_socket(), start_serving=False
+    )
+    events_reader, events_writer = await manager.ipc.get_event_stream()
     manager.event_reader = events_reader
 
     try:
@@ -125,6 +389,7 @@ async def run_daemon():
         )
         raise SystemExit(1)
 
+    systemd.notify("READY=1")
     try:
         await manager.run()
     except KeyboardInterrupt:
@@ -132,13 +397,91 @@ async def run_daemon():
     except asyncio.CancelledError:
         print("Bye!")
     finally:
+        systemd.notify("STOPPING=1")
         events_writer.close()
         await events_writer.wait_closed()
         manager.server.close()
         await manager.server.wait_closed()
 
 
+async def connect():
+    for retry in range(CONNECT_RETRIES):
+        try:
+            return await asyncio.open_unix_connection(CONTROL)
+        except (FileNotFoundError, ConnectionRefusedError):
+            # the daemon may be starting
+            if retry == CONNECT_RETRIES - 1:
+                raise
+            await asyncio.sleep(0.1)
+    raise AssertionError("unreachable")
+
+
+def percentile(values: list[float], ratio: float) -> float:
+    "Nearest-rank percentile"
+    ordered = sorted(values)
+    return ordered[max(0, min(len(ordered) - 1, math.ceil(ratio * len(ordered)) - 1))]
+
+
+async def run_bench(args: list[str]):
+    """Runs a command several times through the control socket and prints its latency"""
+    json_output = "--json" in args
+    args = [arg for arg in args if arg != "--json"]
+    try:
+        command, count = args[0], int(args[1]) if len(args) > 1 else 10
+        if count < 1 or len(args) > 2:
+            raise ValueError()
+    except (IndexError, ValueError):
+        print(
+            'Syntax: pypr bench <command> [count >= 1] [--json], eg: pypr bench "toggle term" 20'
+        )
+        raise SystemExit(1)
+
+    samples = []
+    for _ in range(count):
+        start = time.monotonic()
+        reader, writer = await connect()
+        connected = time.monotonic()
+        writer.write(f"{REPORT_MARKER}{command}\n".encode())
+        await writer.drain()
+        reply = await reader.readline()
+        done = time.monotonic()
+        writer.close()
+        await writer.wait_closed()
+        if not reply:
+            print("The daemon didn't reply, is it up to date?")
+            raise SystemExit(1)
+        sample = json.loads(reply)
+        sample.update(end_to_end=done - start, connect=connected - start)
+        samples.append(sample)
+
+    metrics = ["end_to_end", "connect", "total", "dispatch", "ipc", "wait"]
+    summary = {
+        name: {
+            f"p{p}": percentile([s[name] for s in samples], p / 100)
+            for p in (50, 95, 99)
+        }
+        for name in metrics
+    }
+    if json_output:
+        print(json.dumps({"command": command, "summary": summary, "samples": samples}))
+        return
+    print(f"{command!r} x {count}, milliseconds:")
+    print(f" {'':12} {'p50':>8} {'p95':>8} {'p99':>8}")
+    for name in metrics:
+        values = " ".join(f"{v * 1000:8.2f}" for v in summary[name].values())
+        print(f" {name:12} {values}")
+    ipc_calls = sum(s["ipc_calls"] for s in samples) / count
+    print(f" {ipc_calls:.1f} IPC round trips per command")
+    if not any(s["handlers"] for s in samples):
+        print(" Warning: no handler was called, is the command valid?")
+    if any(s["errors"] for s in samples):
+        print(" Warning: some handlers failed, check the daemon output")
+
+
 async def run_client():
+    if sys.argv[1] == "bench":
+        await run_bench(sys.argv[2:])
+        return
     if sys.argv[1] in ("--help", "-h"):
         manager = Pyprland()
         await manager.load_config(init=False)
@@ -149,7 +492,12 @@ If command is ommited, runs the daemon which will start every configured command
 
 Commands:
 
- reload               Reloads the config file (only supports adding or updating plugins)"""
+ reload               Reloads the config file (only supports adding or updating plugins)
+ dump_trace [path]    Writes the recorded trace spans in the Chrome trace-event format
+ timers               Prints the timers statistics and pending keys
+ load                 Prints the event loop lag and IPC round trip averages
+ locks                Prints the resource locks statistics and the plugins still processing events
+ bench <command> [n]  Runs "command" n times (default: 10) and prints its latency, add --json for a JSON output"""
         )
         for plug in manager.plugins.values():
             for name in dir(plug):
@@ -162,7 +510,7 @@ Commands:
 
         return
 
-    _, writer = await asyncio.open_unix_connection(CONTROL)
+    _, writer = await connect()
     writer.write((" ".join(sys.argv[1:])).encode())
     await writer.drain()
     writer.close()
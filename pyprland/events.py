@@ -0,0 +1,168 @@
+"""Normalization of the Hyprland events.
+
+Hyprland emits some events twice (eg: `activewindow` then `activewindowv2`),
+each one carrying a part of the information. The normalizer merges each pair
+into a single `Event`, dispatched to the `on_<name>` handlers, so plugins get
+parsed values and process each change once.
+"""
+from dataclasses import dataclass
+
+
+@dataclass
+class Event:
+    name: str
+    address: str = ""
+    "Window address, without the 0x prefix"
+    klass: str = ""
+    title: str = ""
+    workspace_id: int | None = None
+    workspace_name: str = ""
+    monitor: str = ""
+    description: str = ""
+    "Monitor description"
+    state: str = ""
+    "Raw value of the events not listed above (eg: fullscreen)"
+
+    def set_workspace(self, name: str, wid: str | None = None) -> None:
+        self.workspace_name = name
+        if wid is not None:
+            self.workspace_id = int(wid)
+        elif name.lstrip("-").isdigit():
+            self.workspace_id = int(name)
+
+
+def _window(event, params):
+    event.address = params
+
+
+def _activewindow(event, params):
+    event.klass, event.title = params.split(",", 1)
+
+
+def _openwindow(event, params):
+    event.address, workspace, event.klass, event.title = params.split(",", 3)
+    event.set_workspace(workspace)
+
+
+def _movewindow(event, params):
+    event.address, workspace = params.split(",", 1)
+    event.set_workspace(workspace)
+
+
+def _movewindowv2(event, params):
+    event.address, wid, workspace = params.split(",", 2)
+    event.set_workspace(workspace, wid)
+
+
+def _windowtitlev2(event, params):
+    event.address, event.title = params.split(",", 1)
+
+
+def _workspace(event, params):
+    event.set_workspace(params)
+
+
+def _workspacev2(event, params):
+    wid, workspace = params.split(",", 1)
+    event.set_workspace(workspace, wid)
+
+
+def _focusedmon(event, params):
+    event.monitor, workspace = params.split(",", 1)
+    event.set_workspace(workspace)
+
+
+def _focusedmonv2(event, params):
+    event.monitor, wid = params.split(",", 1)
+    event.workspace_id = int(wid)
+
+
+def _moveworkspace(event, params):
+    workspace, event.monitor = params.split(",", 1)
+    event.set_workspace(workspace)
+
+
+def _moveworkspacev2(event, params):
+    wid, workspace, event.monitor = params.split(",", 2)
+    event.set_workspace(workspace, wid)
+
+
+def _monitor(event, params):
+    event.monitor = params
+
+
+def _monitorv2(event, params):
+    _, event.monitor, event.description = params.split(",", 2)
+
+
+def _state(event, params):
+    event.state = params
+
+
+PARSERS = {
+    "activewindow": _activewindow,
+    "activewindowv2": _window,
+    "openwindow": _openwindow,
+    "closewindow": _window,
+    "movewindow": _movewindow,
+    "movewindowv2": _movewindowv2,
+    "windowtitle": _window,
+    "windowtitlev2": _windowtitlev2,
+    "urgent": _window,
+    "workspace": _workspace,
+    "workspacev2": _workspacev2,
+    "createworkspace": _workspace,
+    "createworkspacev2": _workspacev2,
+    "destroyworkspace": _workspace,
+    "destroyworkspacev2": _workspacev2,
+    "focusedmon": _focusedmon,
+    "focusedmonv2": _focusedmonv2,
+    "moveworkspace": _moveworkspace,
+    "moveworkspacev2": _moveworkspacev2,
+    "monitoradded": _monitor,
+    "monitoraddedv2": _monitorv2,
+    "monitorremoved": _monitor,
+    "monitorremovedv2": _monitorv2,
+}
+
+# events followed by a "v2" counterpart
+PAIRED = {name for name in PARSERS if f"{name}v2" in PARSERS}
+
+
+def parse(name: str, params: str, event: Event | None = None) -> Event:
+    "Parses the event parameters, completing `event` if provided"
+    if event is None:
+        event = Event(name)
+    try:
+        PARSERS.get(name, _state)(event, params)
+    except ValueError:  # unexpected format, keep it raw
+        event.state = params
+    return event
+
+
+class EventNormalizer:
+    def __init__(self):
+        self.pending: Event | None = None
+
+    def feed(self, name: str, params: str) -> list[Event]:
+        """Processes a raw event. Returns the events ready to be dispatched.
+        A first event of a pair is held until the next one is fed or `flush` is called.
+        """
+        ready = []
+        if self.pending:
+            if name == f"{self.pending.name}v2":
+                event, self.pending = self.pending, None
+                return [parse(name, params, event)]
+            ready.append(self.pending)
+            self.pending = None
+        if name in PAIRED:
+            self.pending = parse(name, params)
+        elif name.endswith("v2") and name[:-2] in PAIRED:  # v2 without v1
+            ready.append(parse(name, params, Event(name[:-2])))
+        else:
+            ready.append(parse(name, params))
+        return ready
+
+    def flush(self) -> list[Event]:
+        pending, self.pending = self.pending, None
+        return [pending] if pending else []
@@ -1,33 +1,34 @@
 #!/bin/env python
 import asyncio
-from typing import Any
+from typing import Any, Callable
 import json
 import os
+import re
+import time
 
 from .common import DEBUG
+from .load import load_monitor
+from .tracing import tracer
 
 
-HYPRCTL = f'/tmp/hypr/{ os.environ["HYPRLAND_INSTANCE_SIGNATURE"] }/.socket.sock'
-EVENTS = f'/tmp/hypr/{ os.environ["HYPRLAND_INSTANCE_SIGNATURE"] }/.socket2.sock'
+def get_hypr_dir() -> str:
+    "Returns the folder of the Hyprland sockets ($XDG_RUNTIME_DIR/hypr since Hyprland 0.40)"
+    sig = os.environ["HYPRLAND_INSTANCE_SIGNATURE"]
+    runtime_dir = os.environ.get("XDG_RUNTIME_DIR")
+    if runtime_dir and os.path.isdir(os.path.join(runtime_dir, "hypr", sig)):
+        return os.path.join(runtime_dir, "hypr", sig)
+    return f"/tmp/hypr/{sig}"
 
 
-async def get_event_stream():
-    return await asyncio.open_unix_connection(EVENTS)
+HYPR_DIR = get_hypr_dir()
+HYPRCTL = os.path.join(HYPR_DIR, ".socket.sock")
+EVENTS = os.path.join(HYPR_DIR, ".socket2.sock")
 
-
-async def hyprctlJSON(command) -> list[dict[str, Any]] | dict[str, Any]:
-    """Run an IPC command and return the JSON output."""
-    if DEBUG:
-        print("(JS)>>>", command)
-    ctl_reader, ctl_writer = await asyncio.open_unix_connection(HYPRCTL)
-    ctl_writer.write(f"-j/{command}".encode())
-    await ctl_writer.drain()
-    resp = await ctl_reader.read()
-    ctl_writer.close()
-    await ctl_writer.wait_closed()
-    ret = json.loads(resp)
-    assert isinstance(ret, (list, dict))
-    return ret
+CAPABILITIES_FILE = os.path.join(
+    os.environ.get("XDG_CACHE_HOME") or os.path.expanduser("~/.cache"),
+    "pyprland",
+    "capabilities.json",
+)
 
 
 def _format_command(command_list, default_base_command):
@@ -38,32 +39,206 @@ def _format_command(command_list, default_base_command):
             yield f"{command[1]} {command[0]}"
 
 
-async def hyprctl(command, base_command="dispatch") -> bool:
-    """Run an IPC command. Returns success value."""
-    if DEBUG:
-        print(">>>", command)
-    ctl_reader, ctl_writer = await asyncio.open_unix_connection(HYPRCTL)
-    if isinstance(command, list):
-        ctl_writer.write(
-            f"[[BATCH]] {' ; '.join(_format_command(command, base_command))}".encode()
-        )
-    else:
-        ctl_writer.write(f"/{base_command} {command}".encode())
-    await ctl_writer.drain()
-    resp = await ctl_reader.read(100)
-    ctl_writer.close()
-    await ctl_writer.wait_closed()
-    if DEBUG:
-        print("<<<", resp)
-    r: bool = resp == b"ok" * (len(resp) // 2)
-    if DEBUG and not r:
-        print(f"FAILED {resp}")
-    return r
-
-
-async def get_focused_monitor_props() -> dict[str, Any]:
-    for monitor in await hyprctlJSON("monitors"):
-        assert isinstance(monitor, dict)
-        if monitor.get("focused") == True:
-            return monitor
-    raise RuntimeError("no focused monitor")
+class Transport:
+    """Compositor IPC interface, given to every plugin as `self.ipc`.
+
+    Implementations provide `query`, `dispatch` and `get_event_stream`."""
+
+    def __init__(self, capabilities_file: str | None = None):
+        self.capabilities = Capabilities(self, capabilities_file)
+
+    async def query(self, command: str) -> Any:
+        "Returns the decoded JSON reply of a command, raises ValueError if not JSON"
+        raise NotImplementedError()
+
+    async def dispatch(self, commands: list[str]) -> bool:
+        "Runs some commands (eg: `dispatch workspace 1`) in a single round trip"
+        raise NotImplementedError()
+
+    async def get_event_stream(self) -> tuple[asyncio.StreamReader, Any]:
+        "Returns a (reader, writer) pair, the reader providing the socket2 lines"
+        raise NotImplementedError()
+
+    async def hyprctlJSON(self, command) -> list[dict[str, Any]] | dict[str, Any]:
+        """Run an IPC command and return the JSON output."""
+        if DEBUG:
+            print("(JS)>>>", command)
+        start = time.monotonic()
+        with tracer.span("hyprctlJSON", "ipc", command=command):
+            ret = await self.query(command)
+        load_monitor.record_rtt(time.monotonic() - start)
+        assert isinstance(ret, (list, dict))
+        return ret
+
+    async def hyprctl(self, command, base_command="dispatch") -> bool:
+        """Run an IPC command. Returns success value."""
+        if DEBUG:
+            print(">>>", command)
+        if isinstance(command, list):
+            commands = list(_format_command(command, base_command))
+        else:
+            commands = [f"{base_command} {command}"]
+        start = time.monotonic()
+        with tracer.span("hyprctl", "ipc", command=command):
+            r = await self.dispatch(commands)
+        load_monitor.record_rtt(time.monotonic() - start)
+        if DEBUG and not r:
+            print(f"FAILED {command}")
+        return r
+
+    async def get_focused_monitor_props(self) -> dict[str, Any]:
+        for monitor in await self.hyprctlJSON("monitors"):
+            assert isinstance(monitor, dict)
+            if monitor.get("focused") == True:
+                return monitor
+        raise RuntimeError("no focused monitor")
+
+
+class SocketTransport(Transport):
+    "Hyprland's unix sockets"
+
+    async def query(self, command: str) -> Any:
+        ctl_reader, ctl_writer = await asyncio.open_unix_connection(HYPRCTL)
+        ctl_writer.write(f"-j/{command}".encode())
+        await ctl_writer.drain()
+        resp = await ctl_reader.read()
+        ctl_writer.close()
+        await ctl_writer.wait_closed()
+        return json.loads(resp)
+
+    async def dispatch(self, commands: list[str]) -> bool:
+        ctl_reader, ctl_writer = await asyncio.open_unix_connection(HYPRCTL)
+        if len(commands) == 1:
+            ctl_writer.write(f"/{commands[0]}".encode())
+        else:
+            ctl_writer.write(f"[[BATCH]] {' ; '.join(commands)}".encode())
+        await ctl_writer.drain()
+        resp = await ctl_reader.read(100)
+        ctl_writer.close()
+        await ctl_writer.wait_closed()
+        if DEBUG:
+            print("<<<", resp)
+        return resp == b"ok" * (len(resp) // 2)
+
+    async def get_event_stream(self):
+        return await asyncio.open_unix_connection(EVENTS)
+
+
+class MemoryTransport(Transport):
+    """In-process transport, to run plugins without a compositor (tests, benchmarks).
+
+    Queries are answered from `replies`, using the full command or its first word
+    as key, values can be callables receiving the command. Dispatched commands are
+    recorded in `dispatched`, events can be sent using `emit`.
+    """
+
+    def __init__(self, replies: dict[str, Any | Callable[[str], Any]] | None = None):
+        super().__init__()
+        self.replies = replies or {}
+        self.dispatched: list[str] = []
+        self._events: asyncio.StreamReader | None = None
+
+    @property
+    def events(self) -> asyncio.StreamReader:
+        if self._events is None:  # needs the event loop
+            self._events = asyncio.StreamReader()
+        return self._events
+
+    async def query(self, command: str) -> Any:
+        reply = self.replies.get(command, self.replies.get(command.split(None, 1)[0]))
+        if reply is None:
+            raise ValueError(f"No reply for {command}")
+        return reply(command) if callable(reply) else reply
+
+    async def dispatch(self, commands: list[str]) -> bool:
+        self.dispatched.extend(commands)
+        return True
+
+    async def get_event_stream(self):
+        return self.events, None
+
+    def emit(self, name: str, params: str) -> None:
+        self.events.feed_data(f"{name}>>{params}\n".encode())
+
+
+class Capabilities:
+    """Features of the running compositor.
+
+    The version is queried on startup (see `at_least`), the options availability is
+    probed on demand and saved for each compositor build, so it's never probed twice.
+    """
+
+    def __init__(self, ipc: Transport, cache_file: str | None = None):
+        self.ipc = ipc
+        self.cache_file = cache_file
+        self.version: dict[str, Any] = {}
+        self.build = ""
+        self.options: dict[str, bool] = {}
+
+    async def probe(self) -> None:
+        try:
+            version = await self.ipc.hyprctlJSON("version")
+            assert isinstance(version, dict)
+        except (ValueError, AssertionError):  # very old version, no JSON output
+            version = {}
+        self.version = version
+        self.build = f"{version.get('tag', '')}-{version.get('commit', '')}"
+        if version.get("dirty"):
+            self.build += "-dirty"
+        self.options = self._load().get(self.build, {})
+
+    def at_least(self, *version: int) -> bool:
+        "Tells if the compositor is at least `version` (eg: 0, 40), False if it's unknown"
+        match = re.match(r"v?(\d+)\.(\d+)(?:\.(\d+))?", self.version.get("tag", ""))
+        if not match:
+            return False
+        return tuple(int(n or 0) for n in match.groups()) >= version
+
+    async def has_option(self, name: str) -> bool:
+        if name not in self.options:
+            try:
+                await self.ipc.hyprctlJSON(f"getoption {name}")
+            except (ValueError, AssertionError):  # "no such option", not JSON
+                self.options[name] = False
+            else:
+                self.options[name] = True
+            self._save()
+        return self.options[name]
+
+    async def first_option(self, *names: str) -> str | None:
+        "Returns the first option available (options often got renamed)"
+        for name in names:
+            if await self.has_option(name):
+                return name
+        return None
+
+    def _load(self) -> dict[str, dict[str, bool]]:
+        if not self.cache_file:
+            return {}
+        try:
+            with open(self.cache_file, encoding="utf-8") as f:
+                return json.load(f)
+        except (OSError, ValueError):
+            return {}
+
+    def _save(self) -> None:
+        if not self.cache_file or not self.build:
+            return
+        cache = self._load()
+        cache[self.build] = self.options
+        try:
+            os.makedirs(os.path.dirname(self.cache_file), exist_ok=True)
+            with open(self.cache_file, "w", encoding="utf-8") as f:
+                json.dump(cache, f)
+        except OSError as e:
+            print(f"Can't save the capabilities: {e}")
+
+
+default_transport = SocketTransport(CAPABILITIES_FILE)
+
+# Module level shortcuts, using the default transport
+
+hyprctlJSON = default_transport.hyprctlJSON
+hyprctl = default_transport.hyprctl
+get_event_stream = default_transport.get_event_stream
+get_focused_monitor_props = default_transport.get_focused_monitor_props
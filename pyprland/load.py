@@ -0,0 +1,86 @@
+"""Daemon load tracking, used to skip the animations when the system is busy.
+
+The event loop lag is sampled periodically (how late a timer fires), the IPC
+round trip times are reported by the transport. Both are smoothed (EWMA),
+the daemon is "degraded" once one of them exceeds its threshold and until
+both fall below half of their threshold, so it doesn't flap.
+"""
+import asyncio
+from typing import Any
+
+from .timers import TimerService
+
+ALPHA = 0.3  # weight of a new sample
+RECOVERY = 0.5  # ratio of the thresholds under which animations come back
+
+
+class LoadMonitor:
+    def __init__(self):
+        self.max_lag = 0.05
+        self.max_rtt = 0.05
+        self.interval = 0.5
+        self.lag = 0.0
+        self.rtt = 0.0
+        self.degraded = False
+        self.stats = {"degraded": 0, "rtt_samples": 0}
+        self._rtt_seen = False
+        self._timers: TimerService | None = None
+
+    def configure(self, config: dict[str, Any]) -> None:
+        "Reads the `load_thresholds` configuration (seconds), a threshold set to 0 is ignored"
+        self.max_lag = config.get("lag", 0.05)
+        self.max_rtt = config.get("rtt", 0.05)
+        self.interval = config.get("interval", 0.5)
+        self._update()
+
+    def start(self, timers: TimerService) -> None:
+        if self._timers is None:
+            self._timers = timers
+            self._schedule()
+
+    def record_rtt(self, duration: float) -> None:
+        self.rtt += ALPHA * (duration - self.rtt)
+        self._rtt_seen = True
+        self.stats["rtt_samples"] += 1
+        self._update()
+
+    def metrics(self) -> dict[str, Any]:
+        return dict(self.stats, lag=self.lag, rtt=self.rtt, degraded=self.degraded)
+
+    def _schedule(self) -> None:
+        assert self._timers
+        deadline = asyncio.get_running_loop().time() + self.interval
+        self._timers.schedule("pyprland.load", self.interval, self._probe, deadline)
+
+    def _probe(self, deadline: float) -> None:
+        lag = max(0.0, asyncio.get_running_loop().time() - deadline)
+        self.lag += ALPHA * (lag - self.lag)
+        if not self._rtt_seen:  # idle, forget the old round trips
+            self.rtt -= ALPHA * self.rtt
+        self._rtt_seen = False
+        self._update()
+        self._schedule()
+
+    def _over(self, ratio: float) -> bool:
+        return bool(
+            (self.max_lag and self.lag > self.max_lag * ratio)
+            or (self.max_rtt and self.rtt > self.max_rtt * ratio)
+        )
+
+    def _update(self) -> None:
+        if self.degraded:
+            degraded = self._over(RECOVERY)
+        else:
+            degraded = self._over(1)
+        if degraded != self.degraded:
+            self.degraded = degraded
+            if degraded:
+                self.stats["degraded"] += 1
+            print(
+                f"{'High' if degraded else 'Normal'} load"
+                f" (lag {self.lag * 1000:.0f}ms, ipc {self.rtt * 1000:.0f}ms),"
+                f" animations {'disabled' if degraded else 'enabled'}"
+            )
+
+
+load_monitor = LoadMonitor()
@@ -0,0 +1,114 @@
+"""Resource locks, allowing the handlers to run concurrently.
+
+Plugins hold the windows, workspaces or monitors they change while changing them:
+
+    async with self.locks.hold(("window", address), ("workspace", "3")):
+        await self.hyprctl([...])
+
+Handlers touching different resources run in parallel, the others wait for
+each other in arrival order. The keys of a hold are always acquired in the
+same (sorted) order, so two holds can't deadlock each other. A task can hold
+a key again while holding it (eg: a command calling another one).
+"""
+import asyncio
+import time
+from collections import deque
+from contextlib import asynccontextmanager
+from typing import Any, AsyncIterator, Hashable
+
+from .tracing import tracer
+
+LAYOUT = ("layout", "workspaces")
+"""Placement of the workspaces on the monitors, held by the changes depending on
+every monitor (the workspaces involved are only known once it's queried)"""
+
+
+class ResourceLock:
+    __slots__ = ("owner", "depth", "waiters")
+
+    def __init__(self, owner: asyncio.Task | None):
+        self.owner = owner
+        self.depth = 1
+        self.waiters: deque[tuple[asyncio.Task | None, asyncio.Future]] = deque()
+
+
+def key_kind(key: Hashable) -> str:
+    return str(key[0]) if isinstance(key, tuple) and key else str(key)
+
+
+class LockManager:
+    def __init__(self):
+        # only the held keys are present
+        self._locks: dict[Hashable, ResourceLock] = {}
+        self.stats = {"acquired": 0, "contended": 0, "wait_time": 0.0, "max_wait": 0.0}
+        # kind of key (eg: "window") => number of contended acquisitions
+        self.contention: dict[str, int] = {}
+
+    @asynccontextmanager
+    async def hold(self, *keys: Hashable) -> AsyncIterator[None]:
+        """Holds every key until the end of the block, keys are usually tuples
+        such as ("window", address), ("workspace", name) or ("monitor", name)"""
+        task = asyncio.current_task()
+        acquired = []
+        try:
+            for key in sorted(set(keys), key=repr):
+                await self._acquire(key, task)
+                acquired.append(key)
+            yield
+        finally:
+            for key in reversed(acquired):
+                self._release(key)
+
+    def held(self, key: Hashable) -> bool:
+        return key in self._locks
+
+    def metrics(self) -> dict[str, Any]:
+        return dict(
+            self.stats,
+            held=len(self._locks),
+            waiting=sum(len(lock.waiters) for lock in self._locks.values()),
+            contention=dict(self.contention),
+        )
+
+    async def _acquire(self, key: Hashable, task: asyncio.Task | None) -> None:
+        self.stats["acquired"] += 1
+        lock = self._locks.get(key)
+        if lock is None:
+            self._locks[key] = ResourceLock(task)
+            return
+        if lock.owner is task:
+            lock.depth += 1
+            return
+        kind = key_kind(key)
+        self.stats["contended"] += 1
+        self.contention[kind] = self.contention.get(kind, 0) + 1
+        waiter = (task, asyncio.get_running_loop().create_future())
+        lock.waiters.append(waiter)
+        start = time.monotonic()
+        try:
+            with tracer.span("lock", "wait", key=repr(key)):
+                await waiter[1]
+        except asyncio.CancelledError:
+            if waiter[1].done() and not waiter[1].cancelled():
+                self._release(key)  # was handed the lock meanwhile
+            elif waiter in lock.waiters:
+                lock.waiters.remove(waiter)
+            raise
+        finally:
+            waited = time.monotonic() - start
+            self.stats["wait_time"] += waited
+            self.stats["max_wait"] = max(self.stats["max_wait"], waited)
+
+    def _release(self, key: Hashable) -> None:
+        lock = self._locks[key]
+        lock.depth -= 1
+        if lock.depth:
+            return
+        while lock.waiters:  # hand it to the next waiter, in arrival order
+            owner, future = lock.waiters.popleft()
+            if not future.done():
+                lock.owner = owner
+                lock.depth = 1
+                future.set_result(None)
+                return
+        del self._locks[key]
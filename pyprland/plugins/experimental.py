@@ -1,7 +1,5 @@
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
-
 
 class Extension(Plugin):
     pass
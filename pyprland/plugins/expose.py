@@ -1,51 +1,111 @@
 from typing import Any
+from ..events import Event
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
+
+EXPOSED_NAME = "exposed"
+EXPOSED = f"special:{EXPOSED_NAME}"
+
+
+def workspace_target(name: str) -> str:
+    "Returns the workspace argument for a dispatcher, given the workspace name"
+    if name.isdigit() or name.startswith("special"):
+        return name
+    return f"name:{name}"
 
 
 class Extension(Plugin):
     async def init(self) -> None:
         self.exposed = False
+        # exposed client address => workspace to restore
+        self.origins: dict[str, str] = {}
+        self.return_workspace = ""
+
+    def get_state(self):
+        return {"exposed": self.exposed}
 
     async def run_toggle_minimized(self, special_workspace="minimized"):
         """[name] Toggles switching the focused window to the special workspace "name" (default: minimized)"""
-        aw: dict[str, Any] = await hyprctlJSON("activewindow")
+        aw: dict[str, Any] = await self.hyprctlJSON("activewindow")
         wid = aw["workspace"]["id"]
         assert isinstance(wid, int)
         if wid < 1:  # special workspace: unminimize
-            wrk = await hyprctlJSON("activeworkspace")
-            await hyprctl(f"togglespecialworkspace {special_workspace}")
-            await hyprctl(f"movetoworkspacesilent {wrk['id']},address:{aw['address']}")
-            await hyprctl(f"focuswindow address:{aw['address']}")
+            wrk = await self.hyprctlJSON("activeworkspace")
+            await self.hyprctl(f"togglespecialworkspace {special_workspace}")
+            await self.hyprctl(
+                f"movetoworkspacesilent {wrk['id']},address:{aw['address']}"
+            )
+            await self.hyprctl(f"focuswindow address:{aw['address']}")
         else:
-            await hyprctl(
+            await self.hyprctl(
                 f"movetoworkspacesilent special:{special_workspace},address:{aw['address']}"
             )
 
-    @property
-    def exposed_clients(self):
-        if self.config.get("include_special", False):
-            return self.exposed
-        else:
-            return [c for c in self.exposed if c["workspace"]["id"] > 0]
+    # Exposed clients tracking, the workspaces come from the shared client index
+
+    async def on_openwindow(self, event: Event):
+        if self.exposed and event.workspace_name == EXPOSED:
+            self.origins[event.address] = self.return_workspace
+
+    async def on_closewindow(self, event: Event):
+        self.origins.pop(event.address, None)
+
+    async def on_movewindow(self, event: Event):
+        if self.exposed:
+            if event.workspace_name == EXPOSED:
+                self.origins.setdefault(event.address, self.return_workspace)
+            else:
+                self.origins.pop(event.address, None)  # moved out of the expose
+
+    @staticmethod
+    def resources(addresses) -> list[tuple[str, str]]:
+        "Lock keys of the expose, given the addresses of the clients which may move"
+        keys = [("workspace", EXPOSED)]
+        keys.extend(("window", addr) for addr in addresses)
+        return keys
+
+    def exposable(self, workspace: str) -> bool:
+        if workspace.startswith("special"):
+            return workspace != EXPOSED and self.config.get("include_special", False)
+        return True
 
     async def run_expose(self, arg=""):
         """Expose every client on the active workspace. If expose is active restores everything and move to the focused window"""
+        await self.clients.ensure(self.ipc)
+        # hold every client which may move, the state is read again once they're held
         if self.exposed:
-            aw: dict[str, Any] = await hyprctlJSON("activewindow")
-            focused_addr = aw["address"]
-            for client in self.exposed_clients:
-                await hyprctl(
-                    f"movetoworkspacesilent {client['workspace']['id']},address:{client['address']}"
-                )
-            await hyprctl("togglespecialworkspace exposed")
-            await hyprctl(f"focuswindow address:{focused_addr}")
-            self.exposed = False
+            addresses = list(self.origins)
         else:
-            self.exposed = await hyprctlJSON("clients")
-            for client in self.exposed_clients:
-                await hyprctl(
-                    f"movetoworkspacesilent special:exposed,address:{client['address']}"
-                )
-            await hyprctl("togglespecialworkspace exposed")
+            addresses = [c.address for c in self.clients if self.exposable(c.workspace)]
+        async with self.locks.hold(*self.resources(addresses)):
+            if self.exposed:
+                await self.restore()
+            else:
+                await self.expose(set(addresses))
+
+    async def restore(self):
+        aw: dict[str, Any] = await self.hyprctlJSON("activewindow")
+        batch = [
+            f"movetoworkspacesilent {workspace_target(wrkspc)},address:0x{addr}"
+            for addr, wrkspc in self.origins.items()
+        ]
+        batch.append(f"togglespecialworkspace {EXPOSED_NAME}")
+        if aw:
+            batch.append(f"focuswindow address:{aw['address']}")
+        self.exposed = False
+        self.origins = {}
+        await self.hyprctl(batch)
+
+    async def expose(self, held: set[str]):
+        self.return_workspace = (await self.hyprctlJSON("activeworkspace"))["name"]
+        self.origins = {
+            client.address: client.workspace
+            for client in self.clients
+            if client.address in held and self.exposable(client.workspace)
+        }
+        batch = [
+            f"movetoworkspacesilent {EXPOSED},address:0x{addr}" for addr in self.origins
+        ]
+        batch.append(f"togglespecialworkspace {EXPOSED_NAME}")
+        self.exposed = True
+        await self.hyprctl(batch)
@@ -0,0 +1,145 @@
+import re
+from typing import Any
+from ..events import Event
+from .interface import Plugin
+
+
+# (option names, from the most recent, value)
+DEFAULT_SETTINGS = [
+    (("decoration:blur:enabled", "decoration:blur"), 0),
+    (("decoration:shadow:enabled", "decoration:drop_shadow"), 0),
+    (("animations:enabled",), 0),
+]
+
+
+def option_value(option: dict[str, Any], sample: Any) -> str:
+    "Returns the value of a `getoption` reply, using the type of `sample`"
+    if isinstance(sample, int):  # includes booleans
+        return str(option.get("int", 0))
+    if isinstance(sample, float):
+        return str(option.get("float", 0.0))
+    return str(option.get("str", option.get("custom", "")))
+
+
+class Extension(Plugin):
+    async def init(self) -> None:
+        self.active = False
+        # workspace name => address of its fullscreen window
+        self.fullscreen_windows: dict[str, str] = {}
+        self.active_address = ""
+        self.workspace = ""
+        self.matching_window = False
+        self.saved: dict[str, str] = {}
+
+    def get_state(self):
+        return {"active": self.active}
+
+    async def load_config(self, config) -> None:
+        await super().load_config(config)
+        self.settings: dict[str, Any] = {}
+        if "settings" in self.config:
+            for name, value in self.config["settings"].items():
+                if await self.ipc.capabilities.has_option(name):
+                    self.settings[name] = value
+                else:
+                    print(f"gamemode: unknown option {name}")
+        else:
+            for names, value in DEFAULT_SETTINGS:
+                name = await self.ipc.capabilities.first_option(*names)
+                if name:
+                    self.settings[name] = value
+        self.classes = [
+            re.compile(pattern) for pattern in self.config.get("classes", [])
+        ]
+        self.use_fullscreen = self.config.get("fullscreen", True)
+        if not self.active:
+            await self.save_settings()
+            await self.sync_fullscreen()
+
+    async def exit(self) -> None:
+        if self.active:
+            await self.apply(False)
+
+    async def save_settings(self):
+        """Caches the current values so the profile can be reverted without any query"""
+        for name, sample in self.settings.items():
+            option = await self.hyprctlJSON(f"getoption {name}")
+            self.saved[name] = option_value(option, sample)
+
+    async def apply(self, active: bool):
+        if active:
+            values = {
+                name: str(int(value) if isinstance(value, bool) else value)
+                for name, value in self.settings.items()
+            }
+        else:
+            values = self.saved
+        await self.hyprctl(
+            [f"{name} {value}" for name, value in values.items()], "keyword"
+        )
+        self.active = active
+
+    async def sync_fullscreen(self):
+        await self.clients.ensure(self.ipc)
+        self.fullscreen_windows = {
+            w["name"]: w["lastwindow"][2:]
+            for w in await self.hyprctlJSON("workspaces")
+            if w.get("hasfullscreen")
+        }
+        self.workspace = (await self.hyprctlJSON("activeworkspace"))["name"]
+        aw = await self.hyprctlJSON("activewindow")
+        self.active_address = aw["address"][2:] if aw else ""
+
+    def focused_workspace(self) -> str:
+        client = self.clients.get(self.active_address)
+        return client.workspace if client else self.workspace
+
+    async def update(self):
+        fullscreen = self.focused_workspace() in self.fullscreen_windows
+        wanted = (self.use_fullscreen and fullscreen) or self.matching_window
+        if wanted != self.active:
+            await self.apply(wanted)
+
+    async def on_fullscreen(self, event: Event):
+        # applies to the focused window
+        if event.state == "1":
+            self.fullscreen_windows[self.focused_workspace()] = self.active_address
+        else:
+            self.fullscreen_windows.pop(self.focused_workspace(), None)
+        await self.update()
+
+    def forget_window(self, address: str) -> bool:
+        for workspace, fullscreen_address in list(self.fullscreen_windows.items()):
+            if fullscreen_address == address:
+                del self.fullscreen_windows[workspace]
+                return True
+        return False
+
+    async def on_closewindow(self, event: Event):
+        if self.forget_window(event.address):
+            await self.update()
+
+    async def on_movewindow(self, event: Event):
+        # moving a window drops its fullscreen state
+        if self.forget_window(event.address):
+            await self.update()
+
+    async def on_workspace(self, event: Event):
+        # used when the workspace has no window to focus
+        self.workspace = event.workspace_name
+
+    async def on_focusedmon(self, event: Event):
+        self.workspace = event.workspace_name
+
+    async def on_activewindow(self, event: Event):
+        self.active_address = event.address
+        self.matching_window = any(
+            pattern.search(event.klass) for pattern in self.classes
+        )
+        await self.update()
+
+    async def on_configreloaded(self, _):
+        # the config file resets the settings
+        self.active = False
+        await self.save_settings()
+        await self.update()
@@ -1,7 +1,24 @@
 from typing import Any
 
+from ..clients import ClientIndex
+from ..ipc import Transport
+from ..load import LoadMonitor
+from ..locks import LockManager
+from ..timers import TimerService
+
 
 class Plugin:
+    timers: TimerService
+    "Shared timer service, set by the daemon"
+    ipc: Transport
+    "Compositor IPC, set by the daemon"
+    clients: ClientIndex
+    "Shared client index, set by the daemon, call `ensure` before reading it"
+    locks: LockManager
+    "Resource locks shared by the plugins, set by the daemon"
+    load: LoadMonitor
+    "Daemon load, skip the animations when `load.degraded` is set"
+
     def __init__(self, name: str):
         self.name = name
 
@@ -11,6 +28,16 @@ class Plugin:
     async def exit(self):
         return
 
+    async def hyprctl(self, command, base_command="dispatch") -> bool:
+        return await self.ipc.hyprctl(command, base_command)
+
+    async def hyprctlJSON(self, command) -> list[dict[str, Any]] | dict[str, Any]:
+        return await self.ipc.hyprctlJSON(command)
+
+    def get_state(self) -> Any:
+        """Returns a JSON-serializable snapshot of the plugin state, or None."""
+        return None
+
     async def load_config(self, config: dict[str, Any]):
         try:
             self.config = config[self.name]
@@ -1,7 +1,6 @@
+from ..locks import LAYOUT
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
-
 
 def contains(monitor, window):
     if not (
@@ -18,25 +17,31 @@ def contains(monitor, window):
 
 
 class Extension(Plugin):
-    async def run_attract_lost(self, *args):
-        """Brings lost floating windows to the current workspace"""
-        monitors = await hyprctlJSON("monitors")
-        windows = await hyprctlJSON("clients")
+    async def find_lost(self):
+        monitors = await self.hyprctlJSON("monitors")
+        windows = await self.hyprctlJSON("clients")
         lost = [
             win
             for win in windows
             if win["floating"] and not any(contains(mon, win) for mon in monitors)
         ]
-        focused = [mon for mon in monitors if mon["focused"]][0]
-        interval = focused["width"] / (1 + len(lost))
-        intervalY = focused["height"] / (1 + len(lost))
-        batch = []
-        workspace: int = focused["activeWorkspace"]["id"]
-        margin = interval // 2
-        marginY = intervalY // 2
-        for i, window in enumerate(lost):
-            batch.append(f'movetoworkspacesilent {workspace},pid:{window["pid"]}')
-            batch.append(
-                f'movewindowpixel exact {int(margin + focused["x"] + i*interval)} {int(marginY + focused["y"] + i*intervalY)},pid:{window["pid"]}'
-            )
-        await hyprctl(batch)
+        return monitors, lost
+
+    async def run_attract_lost(self, *args):
+        """Brings lost floating windows to the current workspace"""
+        # the windows are only known once queried, hold the layout to query once
+        async with self.locks.hold(LAYOUT):
+            monitors, lost = await self.find_lost()
+            focused = [mon for mon in monitors if mon["focused"]][0]
+            interval = focused["width"] / (1 + len(lost))
+            intervalY = focused["height"] / (1 + len(lost))
+            batch = []
+            workspace: int = focused["activeWorkspace"]["id"]
+            margin = interval // 2
+            marginY = intervalY // 2
+            for i, window in enumerate(lost):
+                batch.append(f'movetoworkspacesilent {workspace},pid:{window["pid"]}')
+                batch.append(
+                    f'movewindowpixel exact {int(margin + focused["x"] + i*interval)} {int(marginY + focused["y"] + i*intervalY)},pid:{window["pid"]}'
+                )
+            await self.hyprctl(batch)
@@ -1,22 +1,23 @@
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
-
 
 class Extension(Plugin):
     async def init(self):
         self.zoomed = False
 
+    def get_state(self):
+        return {"zoomed": self.zoomed}
+
     async def run_zoom(self, *args):
         """[factor] zooms to "factor" or toggles zoom level ommited"""
         if args:
             value = int(args[0])
-            await hyprctl(f"misc:cursor_zoom_factor {value}", "keyword")
+            await self.hyprctl(f"misc:cursor_zoom_factor {value}", "keyword")
             self.zoomed = value != 1
         else:  # toggle
             if self.zoomed:
-                await hyprctl("misc:cursor_zoom_factor 1", "keyword")
+                await self.hyprctl("misc:cursor_zoom_factor 1", "keyword")
             else:
                 fact = int(self.config.get("factor", 2))
-                await hyprctl(f"misc:cursor_zoom_factor {fact}", "keyword")
+                await self.hyprctl(f"misc:cursor_zoom_factor {fact}", "keyword")
             self.zoomed = not self.zoomed
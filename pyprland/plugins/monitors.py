@@ -1,11 +1,11 @@
 from typing import Any
 from .interface import Plugin
-import subprocess
 
-from ..ipc import hyprctlJSON
+from ..events import Event
+from ..spawn import spawn
 
 
-def configure_monitors(monitors, screenid: str, x: int, y: int) -> None:
+async def configure_monitors(monitors, screenid: str, x: int, y: int) -> None:
     x_offset = -x if x < 0 else 0
     y_offset = -y if y < 0 else 0
 
@@ -30,25 +30,24 @@ def configure_monitors(monitors, screenid: str, x: int, y: int) -> None:
         )
 
     command.extend(["--output", screenid, "--pos", f"{x+x_offset},{y+y_offset}"])
-    subprocess.call(command)
+    await spawn(command, quiet=False).wait()
 
 
 class Extension(Plugin):
     async def load_config(self, config) -> None:
         await super().load_config(config)
-        monitors = await hyprctlJSON("monitors")
+        monitors = await self.hyprctlJSON("monitors")
         for monitor in monitors:
-            await self.event_monitoradded(
-                monitor["name"], noDefault=True, monitors=monitors
-            )
+            await self.place_monitor(monitor["name"], noDefault=True, monitors=monitors)
 
-    async def event_monitoradded(
+    async def on_monitoradded(self, event: Event) -> None:
+        await self.place_monitor(event.monitor)
+
+    async def place_monitor(
         self, screenid, noDefault=False, monitors: list | None = None
     ) -> None:
-        screenid = screenid.strip()
-
         if not monitors:
-            monitors: list[dict[str, Any]] = await hyprctlJSON("monitors")
+            monitors: list[dict[str, Any]] = await self.hyprctlJSON("monitors")
 
         for mon in monitors:
             if mon["name"].startswith(screenid):
@@ -81,9 +80,9 @@ class Extension(Plugin):
                             x: int = ref["x"] + ref["width"]
                             y: int = ref["y"]
 
-                        configure_monitors(monitors, screenid, x, y)
+                        await configure_monitors(monitors, screenid, x, y)
                         return
         if not noDefault:
             default_command = self.config.get("unknown")
             if default_command:
-                subprocess.call(default_command, shell=True)
+                spawn(default_command, quiet=False)
@@ -1,38 +1,36 @@
-import subprocess
 from typing import Any
 import asyncio
-from ..ipc import (
-    hyprctl,
-    hyprctlJSON,
-    get_focused_monitor_props,
-)
+import json
 import os
 
+from ..events import Event
+from ..spawn import Process, spawn
 from .interface import Plugin
 
 DEFAULT_MARGIN = 60
 
-
-async def get_client_props_by_address(addr: str):
-    for client in await hyprctlJSON("clients"):
-        assert isinstance(client, dict)
-        if client.get("address") == addr:
-            return client
+POSITIONS_FILE = os.path.join(
+    os.environ.get("XDG_STATE_HOME") or os.path.expanduser("~/.local/state"),
+    "pyprland",
+    "scratchpads.json",
+)
 
 
 class Animations:
+    "Returns the command placing the client for the given animation"
+
     @classmethod
-    async def fromtop(cls, monitor, client, client_uid, margin):
+    def fromtop(cls, monitor, client, client_uid, margin):
         mon_x = monitor["x"]
         mon_y = monitor["y"]
         mon_width = monitor["width"]
 
         client_width = client["size"][0]
         margin_x = int((mon_width - client_width) / 2) + mon_x
-        await hyprctl(f"movewindowpixel exact {margin_x} {mon_y + margin},{client_uid}")
+        return f"movewindowpixel exact {margin_x} {mon_y + margin},{client_uid}"
 
     @classmethod
-    async def frombottom(cls, monitor, client, client_uid, margin):
+    def frombottom(cls, monitor, client, client_uid, margin):
         mon_x = monitor["x"]
         mon_y = monitor["y"]
         mon_width = monitor["width"]
@@ -41,12 +39,10 @@ class Animations:
         client_width = client["size"][0]
         client_height = client["size"][1]
         margin_x = int((mon_width - client_width) / 2) + mon_x
-        await hyprctl(
-            f"movewindowpixel exact {margin_x} {mon_y + mon_height - client_height - margin},{client_uid}"
-        )
+        return f"movewindowpixel exact {margin_x} {mon_y + mon_height - client_height - margin},{client_uid}"
 
     @classmethod
-    async def fromleft(cls, monitor, client, client_uid, margin):
+    def fromleft(cls, monitor, client, client_uid, margin):
         mon_x = monitor["x"]
         mon_y = monitor["y"]
         mon_height = monitor["height"]
@@ -54,10 +50,10 @@ class Animations:
         client_height = client["size"][1]
         margin_y = int((mon_height - client_height) / 2) + mon_y
 
-        await hyprctl(f"movewindowpixel exact {margin + mon_x} {margin_y},{client_uid}")
+        return f"movewindowpixel exact {margin + mon_x} {margin_y},{client_uid}"
 
     @classmethod
-    async def fromright(cls, monitor, client, client_uid, margin):
+    def fromright(cls, monitor, client, client_uid, margin):
         mon_x = monitor["x"]
         mon_y = monitor["y"]
         mon_width = monitor["width"]
@@ -66,9 +62,7 @@ class Animations:
         client_width = client["size"][0]
         client_height = client["size"][1]
         margin_y = int((mon_height - client_height) / 2) + mon_y
-        await hyprctl(
-            f"movewindowpixel exact {mon_width - client_width - margin + mon_x } {margin_y},{client_uid}"
-        )
+        return f"movewindowpixel exact {mon_width - client_width - margin + mon_x } {margin_y},{client_uid}"
 
 
 class Scratch:
@@ -79,15 +73,7 @@ class Scratch:
         self.visible = False
         self.just_created = True
         self.clientInfo = {}
-
-    def isAlive(self) -> bool:
-        path = f"/proc/{self.pid}"
-        if os.path.exists(path):
-            for line in open(os.path.join(path, "status"), "r").readlines():
-                if line.startswith("State"):
-                    state = line.split()[1]
-                    return state in "RSDTt"  # not "Z (zombie)"or "X (dead)"
-        return False
+        self.monitor: dict[str, Any] = {}
 
     def reset(self, pid: int) -> None:
         self.pid = pid
@@ -99,34 +85,53 @@ class Scratch:
     def address(self) -> str:
         return str(self.clientInfo.get("address", ""))[2:]
 
-    async def updateClientInfo(self, clientInfo=None) -> None:
-        if clientInfo is None:
-            clientInfo = await get_client_props_by_address("0x" + self.address)
+    @property
+    def resources(self) -> list[tuple[str, str]]:
+        "Lock keys of the scratch"
+        keys = [("workspace", f"special:scratch_{self.uid}")]
+        if self.address:
+            keys.append(("window", self.address))
+        return keys
+
+    async def updateClientInfo(self, clientInfo) -> None:
         assert isinstance(clientInfo, dict)
         self.clientInfo.update(clientInfo)
 
 
 class Extension(Plugin):
     async def init(self) -> None:
-        self.procs: dict[str, subprocess.Popen] = {}
+        self.procs: dict[str, Process] = {}
         self.scratches: dict[str, Scratch] = {}
         self.transitioning_scratches: set[str] = set()
         self._respawned_scratches: set[str] = set()
         self.scratches_by_address: dict[str, Scratch] = {}
         self.scratches_by_pid: dict[int, Scratch] = {}
         self.focused_window_tracking = dict()
+        self.monitors: dict[str, dict[str, Any]] = {}
+        # scratch name => monitor name => [x, y, width, height], relative to the monitor
+        self.positions: dict[str, dict[str, list[int]]] = {}
+        try:
+            with open(POSITIONS_FILE, encoding="utf-8") as f:
+                self.positions = json.load(f)
+        except (OSError, ValueError):
+            pass
+
+    def get_state(self):
+        return {
+            uid: {"visible": scratch.visible} for uid, scratch in self.scratches.items()
+        }
 
     async def exit(self) -> None:
         async def die_in_piece(scratch: Scratch):
-            proc = self.procs[scratch.uid]
+            proc = self.procs.get(scratch.uid)
+            if proc is None:  # lazy, never started
+                return
             proc.terminate()
-            for n in range(10):
-                if not scratch.isAlive():
-                    break
-                await asyncio.sleep(0.1)
-            if scratch.isAlive():
+            try:
+                await asyncio.wait_for(proc.wait(), 1)
+            except asyncio.TimeoutError:
                 proc.kill()
-            proc.wait()
+                await proc.wait()
 
         await asyncio.gather(
             *(die_in_piece(scratch) for scratch in self.scratches.values())
@@ -154,13 +159,7 @@ class Extension(Plugin):
         self._respawned_scratches.add(name)
         scratch = self.scratches[name]
         old_pid = self.procs[name].pid if name in self.procs else 0
-        self.procs[name] = subprocess.Popen(
-            scratch.conf["command"],
-            stdin=subprocess.DEVNULL,
-            stdout=subprocess.DEVNULL,
-            stderr=subprocess.DEVNULL,
-            shell=True,
-        )
+        self.procs[name] = spawn(scratch.conf["command"])
         pid = self.procs[name].pid
         self.scratches[name].reset(pid)
         self.scratches_by_pid[self.procs[name].pid] = scratch
@@ -168,8 +167,8 @@ class Extension(Plugin):
             del self.scratches_by_pid[old_pid]
 
     # Events
-    async def event_activewindowv2(self, addr) -> None:
-        addr = addr.strip()
+    async def on_activewindow(self, event: Event) -> None:
+        addr = event.address
         scratch = self.scratches_by_address.get(addr)
         if scratch:
             if scratch.just_created:
@@ -185,9 +184,9 @@ class Extension(Plugin):
                     ):
                         await self.run_hide(uid, autohide=True)
 
-    async def event_openwindow(self, params) -> None:
-        addr, wrkspc, kls, title = params.split(",", 3)
-        if wrkspc.startswith("special"):
+    async def on_openwindow(self, event: Event) -> None:
+        addr = event.address
+        if event.workspace_name.startswith("special"):
             item = self.scratches_by_address.get(addr)
             if not item and self._respawned_scratches:
                 await self.updateScratchInfo()
@@ -196,6 +195,65 @@ class Extension(Plugin):
                 self._respawned_scratches.discard(item.uid)
                 await self.run_hide(item.uid, force=True)
                 item.just_created = False
+                # wake up run_show if it's waiting for this window
+                self.timers.cancel(f"scratchpads.respawn.{item.uid}")
+
+    async def on_monitoradded(self, _) -> None:
+        self.monitors = {}  # refreshed when needed
+
+    async def on_monitorremoved(self, _) -> None:
+        self.monitors = {}
+
+    async def on_focusedmon(self, event: Event) -> None:
+        if any(
+            scratch.visible and scratch.conf.get("follow_focus")
+            for scratch in self.scratches.values()
+        ):
+            # only process the last one when the focus moves fast
+            self.timers.schedule(
+                "scratchpads.follow_focus", 0.05, self.follow_focus, event
+            )
+
+    async def follow_focus(self, event: Event) -> None:
+        """Moves the visible "follow_focus" scratches to the focused monitor"""
+        if event.monitor not in self.monitors:
+            self.monitors = {m["name"]: m for m in await self.hyprctlJSON("monitors")}
+        monitor = self.monitors.get(event.monitor)
+        if not monitor:
+            return
+        if event.workspace_id is not None:
+            wrkspc = str(event.workspace_id)
+        else:
+            wrkspc = f"name:{event.workspace_name}"
+        followers = [
+            item
+            for uid, item in self.scratches.items()
+            if item.visible
+            and item.conf.get("follow_focus")
+            and uid not in self.transitioning_scratches
+            and item.monitor.get("name") != monitor["name"]
+        ]
+        if not followers:
+            return
+        resources = [r for item in followers for r in item.resources]
+        async with self.locks.hold(("monitor", monitor["name"]), *resources):
+            batch = []
+            for item in followers:
+                addr = "address:0x" + item.address
+                batch.append(
+                    f"moveworkspacetomonitor special:scratch_{item.uid} {monitor['name']}"
+                )
+                batch.append(f"movetoworkspacesilent {wrkspc},{addr}")
+                placement = self.get_placement(item, monitor, addr)
+                if not placement and "at" in item.clientInfo and item.monitor:
+                    # keep the same offset from the monitor's corner
+                    x = item.clientInfo["at"][0] - item.monitor["x"] + monitor["x"]
+                    y = item.clientInfo["at"][1] - item.monitor["y"] + monitor["y"]
+                    placement = [f"movewindowpixel exact {x} {y},{addr}"]
+                    item.clientInfo["at"] = [x, y]
+                batch.extend(placement)
+                item.monitor = monitor
+            await self.hyprctl(batch)
 
     async def run_toggle(self, uid: str) -> None:
         """<name> toggles visibility of scratchpad "name" """
@@ -209,9 +267,15 @@ class Extension(Plugin):
         else:
             await self.run_show(uid)
 
+    async def get_client_props_by_address(self, addr: str):
+        for client in await self.hyprctlJSON("clients"):
+            assert isinstance(client, dict)
+            if client.get("address") == addr:
+                return client
+
     async def updateScratchInfo(self, scratch: Scratch | None = None) -> None:
         if scratch is None:
-            for client in await hyprctlJSON("clients"):
+            for client in await self.hyprctlJSON("clients"):
                 assert isinstance(client, dict)
                 scratch = self.scratches_by_address.get(client["address"][2:])
                 if not scratch:
@@ -224,10 +288,62 @@ class Extension(Plugin):
             add_to_address_book = ("address" not in scratch.clientInfo) or (
                 scratch.address not in self.scratches_by_address
             )
-            await scratch.updateClientInfo()
+            await scratch.updateClientInfo(
+                await self.get_client_props_by_address("0x" + scratch.address)
+            )
             if add_to_address_book:
                 self.scratches_by_address[scratch.clientInfo["address"][2:]] = scratch
 
+    def get_placement(self, item: Scratch, monitor, addr: str) -> list[str]:
+        "Returns the commands placing the scratch on the monitor (remembered position or animation)"
+        position = None
+        if item.conf.get("remember_position"):
+            position = self.positions.get(item.uid, {}).get(monitor["name"])
+        if position:
+            x, y, width, height = position
+            return [
+                f"resizewindowpixel exact {width} {height},{addr}",
+                f"movewindowpixel exact {monitor['x'] + x} {monitor['y'] + y},{addr}",
+            ]
+        animation_type = item.conf.get("animation", "").lower()
+        if animation_type:
+            margin = item.conf.get("margin", DEFAULT_MARGIN)
+            fn = getattr(Animations, animation_type)
+            return [fn(monitor, item.clientInfo, addr, margin)]
+        return []
+
+    async def save_position(self, item: Scratch, autohide=False) -> None:
+        """Remembers the geometry of the scratch for the monitor it's displayed on.
+        Hyprland doesn't notify moves or resizes, so it's read when hiding: from the active window
+        when the scratch is still focused, else (eg: hidden by `unfocus`) from the whole client list.
+        """
+        addr = "0x" + item.address
+        client = None
+        if not autohide:
+            client = await self.hyprctlJSON("activewindow")
+        if not client or client.get("address") != addr:
+            client = await self.get_client_props_by_address(addr)
+        if not client:
+            return
+        await item.updateClientInfo(client)
+        monitor = item.monitor
+        position = [
+            client["at"][0] - monitor["x"],
+            client["at"][1] - monitor["y"],
+            client["size"][0],
+            client["size"][1],
+        ]
+        positions = self.positions.setdefault(item.uid, {})
+        if positions.get(monitor["name"]) == position:
+            return
+        positions[monitor["name"]] = position
+        try:
+            os.makedirs(os.path.dirname(POSITIONS_FILE), exist_ok=True)
+            with open(POSITIONS_FILE, "w", encoding="utf-8") as f:
+                json.dump(self.positions, f)
+        except OSError as e:
+            print(f"Can't save scratchpads positions: {e}")
+
     async def run_hide(self, uid: str, force=False, autohide=False) -> None:
         """<name> hides scratchpad "name" """
         uid = uid.strip()
@@ -238,10 +354,17 @@ class Extension(Plugin):
         if not item.visible and not force:
             print(f"{uid} is already hidden")
             return
+        async with self.locks.hold(*item.resources):
+            await self._hide(item, autohide)
+
+    async def _hide(self, item: Scratch, autohide) -> None:
+        uid = item.uid
+        if item.conf.get("remember_position") and item.monitor and item.visible:
+            await self.save_position(item, autohide)
         item.visible = False
         addr = "address:0x" + item.address
         animation_type: str = item.conf.get("animation", "").lower()
-        if animation_type:
+        if animation_type and not self.load.degraded:
             offset = item.conf.get("offset")
             if offset is None:
                 if "size" not in item.clientInfo:
@@ -250,36 +373,45 @@ class Extension(Plugin):
                 offset = int(1.3 * item.clientInfo["size"][1])
 
             if animation_type == "fromtop":
-                await hyprctl(f"movewindowpixel 0 -{offset},{addr}")
+                await self.hyprctl(f"movewindowpixel 0 -{offset},{addr}")
             elif animation_type == "frombottom":
-                await hyprctl(f"movewindowpixel 0 {offset},{addr}")
+                await self.hyprctl(f"movewindowpixel 0 {offset},{addr}")
             elif animation_type == "fromleft":
-                await hyprctl(f"movewindowpixel -{offset} 0,{addr}")
+                await self.hyprctl(f"movewindowpixel -{offset} 0,{addr}")
             elif animation_type == "fromright":
-                await hyprctl(f"movewindowpixel {offset} 0,{addr}")
+                await self.hyprctl(f"movewindowpixel {offset} 0,{addr}")
 
             if uid in self.transitioning_scratches:
                 return  # abort sequence
-            await asyncio.sleep(0.2)  # await for animation to finish
-
-        if uid not in self.transitioning_scratches:
-            await hyprctl(f"movetoworkspacesilent special:scratch_{uid},{addr}")
+            # finish once the animation is over, unless it's shown again meanwhile
+            self.timers.schedule(
+                f"scratchpads.hide.{uid}", 0.2, self._finish_hide, uid, addr, autohide
+            )
+        else:
+            await self._finish_hide(uid, addr, autohide, animated=False)
 
-        if (
-            animation_type and uid in self.focused_window_tracking
-        ):  # focus got lost when animating
-            if not autohide and "address" in self.focused_window_tracking[uid]:
-                await hyprctl(
-                    f"focuswindow address:{self.focused_window_tracking[uid]['address']}"
+    async def _finish_hide(self, uid: str, addr: str, autohide, animated=True):
+        async with self.locks.hold(*self.scratches[uid].resources):
+            if uid not in self.transitioning_scratches:
+                await self.hyprctl(
+                    f"movetoworkspacesilent special:scratch_{uid},{addr}"
                 )
-                del self.focused_window_tracking[uid]
+
+            if (
+                animated and uid in self.focused_window_tracking
+            ):  # focus got lost when animating
+                if not autohide and "address" in self.focused_window_tracking[uid]:
+                    await self.hyprctl(
+                        f"focuswindow address:{self.focused_window_tracking[uid]['address']}"
+                    )
+                    del self.focused_window_tracking[uid]
 
     async def run_show(self, uid, force=False) -> None:
         """<name> shows scratchpad "name" """
         uid = uid.strip()
         item = self.scratches.get(uid)
 
-        self.focused_window_tracking[uid] = await hyprctlJSON("activewindow")
+        self.focused_window_tracking[uid] = await self.hyprctlJSON("activewindow")
 
         if not item:
             print(f"{uid} is not configured")
@@ -289,7 +421,11 @@ class Extension(Plugin):
             print(f"{uid} is already visible")
             return
 
-        if not item.isAlive():
+        self.timers.cancel(f"scratchpads.hide.{uid}")
+
+        proc = self.procs.get(uid)
+        # the exited processes are reaped at once, their pid may be reused: don't check /proc
+        if proc is None or proc.exited:
             print(f"{uid} is not running, restarting...")
             if uid in self.procs:
                 self.procs[uid].kill()
@@ -299,10 +435,15 @@ class Extension(Plugin):
                 del self.scratches_by_address[item.address]
             self.start_scratch_command(uid)
             while uid in self._respawned_scratches:
-                await asyncio.sleep(0.05)
+                await self.timers.sleep(f"scratchpads.respawn.{uid}", 1)
 
+        async with self.locks.hold(*item.resources):
+            await self._show(item)
+
+    async def _show(self, item: Scratch) -> None:
+        uid = item.uid
         item.visible = True
-        monitor = await get_focused_monitor_props()
+        monitor = await self.ipc.get_focused_monitor_props()
         assert monitor
 
         await self.updateScratchInfo(item)
@@ -314,13 +455,18 @@ class Extension(Plugin):
         wrkspc = monitor["activeWorkspace"]["id"]
 
         self.transitioning_scratches.add(uid)
-        await hyprctl(f"moveworkspacetomonitor special:scratch_{uid} {monitor['name']}")
-        await hyprctl(f"movetoworkspacesilent {wrkspc},{addr}")
-        if animation_type:
-            margin = item.conf.get("margin", DEFAULT_MARGIN)
-            fn = getattr(Animations, animation_type)
-            await fn(monitor, item.clientInfo, addr, margin)
-
-        await hyprctl(f"focuswindow {addr}")
-        await asyncio.sleep(0.2)  # ensure some time for events to propagate
-        self.transitioning_scratches.discard(uid)
+        item.monitor = monitor
+        batch = [
+            f"moveworkspacetomonitor special:scratch_{uid} {monitor['name']}",
+            f"movetoworkspacesilent {wrkspc},{addr}",
+        ]
+        batch.extend(self.get_placement(item, monitor, addr))
+        batch.append(f"focuswindow {addr}")
+        await self.hyprctl(batch)
+        # ensure some time for events to propagate
+        self.timers.schedule(
+            f"scratchpads.transition.{uid}",
+            0.2,
+            self.transitioning_scratches.discard,
+            uid,
+        )
@@ -1,11 +1,11 @@
+from ..events import Event
+from ..locks import LAYOUT
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
-
 
 class Extension(Plugin):
     async def init(self):
-        self.monitors = [mon["name"] for mon in await hyprctlJSON("monitors")]
+        self.monitors = [mon["name"] for mon in await self.hyprctlJSON("monitors")]
 
     async def run_shift_monitors(self, arg: str):
         """Swaps monitors' workspaces in the given direction"""
@@ -15,11 +15,14 @@ class Extension(Plugin):
         else:
             mon_list = reversed(self.monitors[1:])
 
-        for i, mon in enumerate(mon_list):
-            await hyprctl(f"swapactiveworkspaces {mon} {self.monitors[i+direction]}")
+        async with self.locks.hold(LAYOUT):
+            for i, mon in enumerate(mon_list):
+                await self.hyprctl(
+                    f"swapactiveworkspaces {mon} {self.monitors[i+direction]}"
+                )
 
-    async def event_monitoradded(self, monitor):
-        self.monitors.append(monitor.strip())
+    async def on_monitoradded(self, event: Event):
+        self.monitors.append(event.monitor)
 
-    async def event_monitorremoved(self, monitor):
-        self.monitors.remove(monitor.strip())
+    async def on_monitorremoved(self, event: Event):
+        self.monitors.remove(event.monitor)
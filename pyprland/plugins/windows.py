@@ -0,0 +1,96 @@
+import re
+from functools import lru_cache
+from typing import Callable
+
+from ..clients import Client
+from .interface import Plugin
+
+BATCH_SIZE = 50  # commands sent per round trip
+
+# action name => (number of arguments, dispatcher template)
+ACTIONS = {
+    "move": (1, "movetoworkspacesilent {0},address:0x{addr}"),
+    "float": (0, "setfloating address:0x{addr}"),
+    "tile": (0, "settiled address:0x{addr}"),
+    "pin": (0, "pin address:0x{addr}"),
+    "close": (0, "closewindow address:0x{addr}"),
+}
+
+# floating state set by the actions using setfloating & settiled (Hyprland 0.38),
+# older versions only have togglefloating
+SET_FLOATING = {"float": True, "tile": False}
+SET_FLOATING_VERSION = (0, 38)
+
+
+@lru_cache(maxsize=64)
+def compile_pattern(pattern: str) -> re.Pattern:
+    "Compiles a regex, optionally written /between slashes/"
+    if len(pattern) > 1 and pattern[0] == pattern[-1] == "/":
+        pattern = pattern[1:-1]
+    return re.compile(pattern)
+
+
+def parse_criterion(criterion: str) -> Callable[[Client], bool]:
+    """Returns the predicate for a "key:value" query criterion.
+    class & title take a regular expression, workspace a workspace name."""
+    key, _, value = criterion.partition(":")
+    if key == "class":
+        search = compile_pattern(value).search
+        return lambda client: search(client.klass) is not None
+    if key == "title":
+        search = compile_pattern(value).search
+        return lambda client: search(client.title) is not None
+    if key == "workspace":
+        return lambda client: client.workspace == value
+    raise ValueError(f"unknown criterion {criterion}")
+
+
+class Extension(Plugin):
+    async def run_windows(self, args=""):
+        """<query> <action> [argument] Runs an action on every matching window, eg: "class:^firefox$ move 3" """
+        words = args.split()
+        for i, word in enumerate(words):
+            if word in ACTIONS:
+                criteria, (action, *action_args) = words[:i], words[i:]
+                break
+        else:
+            criteria = []
+        if not criteria:  # don't match every window by mistake
+            print(f"windows: expected <query> <action>, got {args.strip()}")
+            return
+        nargs, template = ACTIONS[action]
+        if len(action_args) != nargs:
+            print(f"windows: {action} takes {nargs} argument(s)")
+            return
+        try:
+            predicates = [parse_criterion(c) for c in criteria]
+        except (ValueError, re.error) as e:
+            print(f"windows: invalid query: {e}")
+            return
+
+        def matching(client: Client) -> bool:
+            return all(match(client) for match in predicates)
+
+        await self.clients.ensure(self.ipc)
+        matches = {client.address for client in self.clients if matching(client)}
+        async with self.locks.hold(*(("window", addr) for addr in matches)):
+            # match again once they're held, they may have changed meanwhile
+            targets = [
+                client.address
+                for client in self.clients
+                if client.address in matches and matching(client)
+            ]
+            if action in SET_FLOATING and not self.ipc.capabilities.at_least(
+                *SET_FLOATING_VERSION
+            ):
+                # only toggle the windows which aren't in the wanted state yet
+                wanted = SET_FLOATING[action]
+                floating = {
+                    c["address"][2:]: c["floating"]
+                    for c in await self.hyprctlJSON("clients")
+                }
+                targets = [a for a in targets if floating.get(a, wanted) != wanted]
+                template = "togglefloating address:0x{addr}"
+            batch = [template.format(*action_args, addr=addr) for addr in targets]
+            for i in range(0, len(batch), BATCH_SIZE):
+                await self.hyprctl(batch[i : i + BATCH_SIZE])
@@ -1,56 +1,149 @@
 import asyncio
+from ..events import Event
+from ..locks import LAYOUT
 from .interface import Plugin
 
-from ..ipc import hyprctlJSON, hyprctl
-
 
 class Extension(Plugin):
     async def load_config(self, config):
         await super().load_config(config)
         self.workspace_list = list(range(1, self.config.get("max_workspaces", 10) + 1))
+        self.per_monitor = self.config.get("mode") == "per_monitor"
+        if self.per_monitor:
+            await self.update_monitor_sets()
 
-    async def event_focusedmon(self, screenid_index):
-        monitor_id, workspace_id = screenid_index.split(",")
-        workspace_id = int(workspace_id)
-        # move every free workspace to the currently focused desktop
-        busy_workspaces = set(
-            mon["activeWorkspace"]["id"]
-            for mon in await hyprctlJSON("monitors")
-            if mon["name"] != monitor_id
-        )
-        workspaces = [w["id"] for w in await hyprctlJSON("workspaces") if w["id"] > 0]
-
-        batch: list[str | list[str]] = []
-        for n in workspaces:
-            if n in busy_workspaces or n == workspace_id:
+    async def update_monitor_sets(self):
+        """Assigns an ordered workspace set to every monitor (per_monitor mode), the sets are disjoint"""
+        monitors = sorted(await self.hyprctlJSON("monitors"), key=lambda m: m["id"])
+        patterns: dict[str, list[int]] = self.config.get("monitors", {})
+        assigned: set[int] = set()
+        sets: dict[str, list[int]] = {}
+        unmatched = []
+        for mon in monitors:
+            for pattern, workspaces in patterns.items():
+                if pattern in mon["description"]:
+                    break
+            else:
+                unmatched.append(mon["name"])
                 continue
-            batch.append(f"moveworkspacetomonitor {n} {monitor_id}")
-        await hyprctl(batch)
+            shared = [w for w in workspaces if w in assigned]
+            if shared:
+                print(f"workspaces {shared} already belong to another monitor")
+            sets[mon["name"]] = [w for w in workspaces if w not in assigned]
+            assigned.update(workspaces)
+
+        # the monitors without a match split the remaining workspaces
+        leftovers = [w for w in self.workspace_list if w not in assigned]
+        if unmatched:
+            size, extra = divmod(len(leftovers), len(unmatched))
+            start = 0
+            for i, name in enumerate(unmatched):
+                end = start + size + (i < extra)
+                sets[name] = leftovers[start:end]
+                start = end
+
+        self.monitor_sets: dict[str, list[int]] = {}
+        self.set_index: dict[str, dict[int, int]] = {}
+        self.active_workspace: dict[str, int] = {}
+        self.focused_monitor = ""
+        for mon in monitors:
+            workspaces = sets[mon["name"]]
+            self.monitor_sets[mon["name"]] = workspaces
+            self.set_index[mon["name"]] = {w: i for i, w in enumerate(workspaces)}
+            self.active_workspace[mon["name"]] = mon["activeWorkspace"]["id"]
+            if mon["focused"]:
+                self.focused_monitor = mon["name"]
+
+    async def on_monitoradded(self, _):
+        if self.per_monitor:
+            await self.update_monitor_sets()
+
+    async def on_monitorremoved(self, _):
+        if self.per_monitor:
+            await self.update_monitor_sets()
+
+    async def on_workspace(self, event: Event):
+        if self.per_monitor and self.focused_monitor:
+            if event.workspace_id is not None:
+                self.active_workspace[self.focused_monitor] = event.workspace_id
+
+    async def on_focusedmon(self, event: Event):
+        monitor_id, workspace_id = event.monitor, event.workspace_id
+        if self.per_monitor:
+            self.focused_monitor = monitor_id
+            if workspace_id is not None:
+                self.active_workspace[monitor_id] = workspace_id
+            return
+        async with self.locks.hold(LAYOUT):
+            # move every free workspace to the currently focused desktop
+            busy_workspaces = set(
+                mon["activeWorkspace"]["id"]
+                for mon in await self.hyprctlJSON("monitors")
+                if mon["name"] != monitor_id
+            )
+            workspaces = [
+                w["id"] for w in await self.hyprctlJSON("workspaces") if w["id"] > 0
+            ]
+            await self.hyprctl(
+                [
+                    f"moveworkspacetomonitor {n} {monitor_id}"
+                    for n in workspaces
+                    if n not in busy_workspaces and n != workspace_id
+                ]
+            )
 
     async def run_change_workspace(self, direction: str):
         """<+1/-1> Switch workspaces of current monitor, avoiding displayed workspaces"""
         increment = int(direction)
-        # get focused screen info
-        monitors = await hyprctlJSON("monitors")
-        assert isinstance(monitors, list)
-        for monitor in monitors:
-            if monitor["focused"]:
-                break
-        assert isinstance(monitor, dict)
-        busy_workspaces = set(
-            m["activeWorkspace"]["id"] for m in monitors if m["id"] != monitor["id"]
-        )
-        cur_workspace = monitor["activeWorkspace"]["id"]
-        available_workspaces = [
-            i for i in self.workspace_list if i not in busy_workspaces
-        ]
-        try:
-            idx = available_workspaces.index(cur_workspace)
-        except ValueError:
-            next_workspace = available_workspaces[0 if increment > 0 else -1]
-        else:
-            next_workspace = available_workspaces[
-                (idx + increment) % len(available_workspaces)
+        if self.per_monitor:
+            return await self.change_monitor_workspace(increment)
+        async with self.locks.hold(LAYOUT):
+            # get focused screen info
+            monitors = await self.hyprctlJSON("monitors")
+            assert isinstance(monitors, list)
+            for monitor in monitors:
+                if monitor["focused"]:
+                    break
+            assert isinstance(monitor, dict)
+            busy_workspaces = set(
+                m["activeWorkspace"]["id"] for m in monitors if m["id"] != monitor["id"]
+            )
+            cur_workspace = monitor["activeWorkspace"]["id"]
+            available_workspaces = [
+                i for i in self.workspace_list if i not in busy_workspaces
             ]
-        await hyprctl(f"moveworkspacetomonitor {next_workspace},{monitor['name']}")
-        await hyprctl(f"workspace {next_workspace}")
+            try:
+                idx = available_workspaces.index(cur_workspace)
+            except ValueError:
+                next_workspace = available_workspaces[0 if increment > 0 else -1]
+            else:
+                next_workspace = available_workspaces[
+                    (idx + increment) % len(available_workspaces)
+                ]
+            await self.hyprctl(
+                f"moveworkspacetomonitor {next_workspace},{monitor['name']}"
+            )
+            await self.hyprctl(f"workspace {next_workspace}")
+
+    async def change_monitor_workspace(self, increment: int):
+        """Cycles in the focused monitor's own workspace set, using the cached state only"""
+        monitor = self.focused_monitor
+        # the sets are disjoint, the monitor is the only resource involved
+        async with self.locks.hold(("monitor", monitor)):
+            workspaces = self.monitor_sets.get(monitor)
+            if not workspaces:
+                print(f"No workspace set for monitor {monitor}")
+                return
+            idx = self.set_index[monitor].get(self.active_workspace.get(monitor, 0))
+            if idx is None:
+                next_workspace = workspaces[0 if increment > 0 else -1]
+            else:
+                next_workspace = workspaces[(idx + increment) % len(workspaces)]
+            await self.hyprctl(
+                [
+                    f"moveworkspacetomonitor {next_workspace} {monitor}",
+                    f"workspace {next_workspace}",
+                ]
+            )
+            # the workspace event is handled once this returns, too late for a quick second press
+            self.active_workspace[monitor] = next_workspace
@@ -0,0 +1,138 @@
+"""Asynchronous process launcher based on posix_spawn.
+
+posix_spawn doesn't copy the daemon memory (glibc uses vfork-like semantics),
+so its cost doesn't grow with the daemon size. Processes are started in their
+own process group and their exit is reported through a pidfd watched by the
+event loop, so waiting for a command never blocks the daemon.
+
+Run `python -m pyprland.spawn [count] [ballast MB]` to compare with subprocess.
+"""
+import asyncio
+import os
+import signal
+import subprocess
+import sys
+import time
+
+STDIO = [
+    (os.POSIX_SPAWN_OPEN, 0, os.devnull, os.O_RDONLY, 0),
+    (os.POSIX_SPAWN_OPEN, 1, os.devnull, os.O_WRONLY, 0),
+    (os.POSIX_SPAWN_OPEN, 2, os.devnull, os.O_WRONLY, 0),
+]
+
+
+class Process:
+    "A spawned process, leading its own process group"
+
+    def __init__(self, pid: int):
+        self.pid = pid
+        self.returncode: int | None = None
+        loop = asyncio.get_running_loop()
+        self._exited = loop.create_future()
+        try:
+            fd = os.pidfd_open(pid)
+        except (AttributeError, OSError):  # no pidfd support, wait in a thread
+            loop.run_in_executor(None, self._wait_blocking, loop)
+        else:
+            loop.add_reader(fd, self._reap, loop, fd)
+
+    @property
+    def exited(self) -> bool:
+        "The process is over, even if its exit status couldn't be read"
+        return self._exited.done()
+
+    def _set_status(self, status: int | None) -> None:
+        "Records the wait status, None if the child was reaped elsewhere (returncode stays unknown)"
+        if status is not None:
+            self.returncode = os.waitstatus_to_exitcode(status)
+        if not self._exited.done():
+            self._exited.set_result(self.returncode)
+
+    def _waitpid(self) -> int | None:
+        try:
+            return os.waitpid(self.pid, 0)[1]
+        except ChildProcessError:  # reaped elsewhere
+            return None
+
+    def _reap(self, loop: asyncio.AbstractEventLoop, fd: int) -> None:
+        loop.remove_reader(fd)
+        os.close(fd)
+        self._set_status(self._waitpid())
+
+    def _wait_blocking(self, loop: asyncio.AbstractEventLoop) -> None:
+        loop.call_soon_threadsafe(self._set_status, self._waitpid())
+
+    def send_signal(self, sig: int) -> None:
+        if not self.exited:
+            try:
+                os.killpg(self.pid, sig)
+            except ProcessLookupError:
+                pass
+
+    def terminate(self) -> None:
+        self.send_signal(signal.SIGTERM)
+
+    def kill(self) -> None:
+        self.send_signal(signal.SIGKILL)
+
+    async def wait(self) -> int | None:
+        "Waits for the exit, returns the exit code (None if unknown)"
+        return await asyncio.shield(self._exited)
+
+
+def spawn(
+    command: str | list[str], env: dict[str, str] | None = None, quiet=True
+) -> Process:
+    """Starts a command (a shell command line if given a string) in a new process group.
+    Its stdio is /dev/null if `quiet`, else inherited from the daemon (to see its errors).
+    Must be called from the event loop."""
+    argv = ["/bin/sh", "-c", command] if isinstance(command, str) else command
+    pid = os.posix_spawnp(
+        argv[0],
+        argv,
+        os.environ if env is None else env,
+        file_actions=STDIO if quiet else None,
+        setpgroup=0,
+    )
+    return Process(pid)
+
+
+async def _bench(count: int) -> None:
+    for name, start in (
+        (
+            "subprocess.Popen",
+            lambda: subprocess.Popen(
+                "true",
+                stdin=subprocess.DEVNULL,
+                stdout=subprocess.DEVNULL,
+                stderr=subprocess.DEVNULL,
+                shell=True,
+            ),
+        ),
+        ("spawn", lambda: spawn("true")),
+    ):
+        durations = []
+        procs = []
+        for _ in range(count):
+            begin = time.perf_counter()
+            procs.append(start())
+            durations.append(time.perf_counter() - begin)
+        for proc in procs:
+            if isinstance(proc, Process):
+                await proc.wait()
+            else:
+                proc.wait()
+        durations.sort()
+        print(
+            f"{name:18} median {durations[count // 2] * 1e6:8.0f}µs"
+            f"   max {durations[-1] * 1e6:8.0f}µs"
+        )
+
+
+if __name__ == "__main__":
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100
+    # simulates a daemon which grew in memory
+    ballast = bytearray(int(sys.argv[2]) * 1024 * 1024) if len(sys.argv) > 2 else b""
+    for i in range(0, len(ballast), 4096):
+        ballast[i] = 1
+    asyncio.run(_bench(count))
@@ -0,0 +1,59 @@
+import json
+import mmap
+import os
+import struct
+from typing import Any
+
+GENERATION = struct.Struct("<Q")
+
+
+def get_state_paths() -> tuple[str, str]:
+    """Returns the (data, generation) file paths for the current Hyprland instance."""
+    base = os.environ.get("XDG_RUNTIME_DIR") or "/tmp"
+    sig = os.environ["HYPRLAND_INSTANCE_SIGNATURE"]
+    prefix = os.path.join(base, f"pyprland-{sig}")
+    return f"{prefix}.json", f"{prefix}.gen"
+
+
+class StateFile:
+    """Publishes a JSON snapshot of the daemon state.
+
+    The snapshot is written to a temporary file and atomically renamed, then
+    a 64 bits little endian generation counter is bumped in a separate
+    memory-mapped file. Readers only have to compare the counter to know if
+    the snapshot changed, eg:
+
+        gen = mmap.mmap(os.open(gen_path, os.O_RDONLY), 8, prot=mmap.PROT_READ)
+        if gen[:8] != last: state = json.load(open(data_path))
+    """
+
+    def __init__(self):
+        self.data_path, self.gen_path = get_state_paths()
+        self._last = b""
+        fd = os.open(self.gen_path, os.O_RDWR | os.O_CREAT, 0o644)
+        try:
+            os.ftruncate(fd, GENERATION.size)
+            self._gen = mmap.mmap(fd, GENERATION.size)
+        finally:
+            os.close(fd)
+        # keep counting from a previous run so readers never see a generation twice
+        self.generation: int = GENERATION.unpack_from(self._gen)[0]
+
+    def publish(self, state: dict[str, Any]) -> bool:
+        """Writes the snapshot if it changed. Returns True if a new generation was published."""
+        data = json.dumps(state, sort_keys=True).encode()
+        if data == self._last:
+            return False
+        self._last = data
+        self.generation += 1
+        tmp_path = f"{self.data_path}.tmp"
+        with open(tmp_path, "wb") as f:
+            f.write(
+                json.dumps({"generation": self.generation, "state": state}).encode()
+            )
+        os.replace(tmp_path, self.data_path)
+        GENERATION.pack_into(self._gen, 0, self.generation)
+        return True
+
+    def close(self) -> None:
+        self._gen.close()
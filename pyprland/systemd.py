@@ -0,0 +1,39 @@
+"""Minimal systemd integration: socket activation & readiness notification.
+
+Implements the `sd_listen_fds` and `sd_notify` protocols, without depending on libsystemd.
+"""
+import os
+import socket
+
+SD_LISTEN_FDS_START = 3
+
+
+def listen_fds() -> list[socket.socket]:
+    """Returns the sockets passed by the service manager (socket activation)."""
+    if os.environ.get("LISTEN_PID") != str(os.getpid()):
+        return []
+    count = int(os.environ.get("LISTEN_FDS", 0))
+    for name in ("LISTEN_PID", "LISTEN_FDS", "LISTEN_FDNAMES"):
+        os.environ.pop(name, None)  # don't leak them to the spawned commands
+    sockets = []
+    for fd in range(SD_LISTEN_FDS_START, SD_LISTEN_FDS_START + count):
+        sock = socket.socket(fileno=fd)
+        sock.set_inheritable(False)  # spawned commands must not keep it open
+        sockets.append(sock)
+    return sockets
+
+
+def notify(state: str) -> bool:
+    """Sends a state (eg: "READY=1") to the service manager. Returns True if sent."""
+    address = os.environ.get("NOTIFY_SOCKET")
+    if not address:
+        return False
+    if address.startswith("@"):  # abstract namespace
+        address = "\0" + address[1:]
+    with socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM | socket.SOCK_CLOEXEC) as sock:
+        try:
+            sock.sendto(state.encode(), address)
+        except OSError as e:
+            print(f"Can't notify the service manager: {e}")
+            return False
+    return True
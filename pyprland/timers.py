@@ -0,0 +1,154 @@
+"""Keyed, cancellable delayed actions shared by every plugin.
+
+Timers live in a single heap driven by one event loop handle, so pending
+actions cost no task until they fire. Scheduling an already pending key
+replaces it (or is ignored with `replace=False`, coalescing bursts).
+"""
+import asyncio
+import contextvars
+import heapq
+import itertools
+import traceback
+from typing import Any, Callable, Hashable
+
+from .tracing import tracer
+
+
+class Timer:
+    __slots__ = ("key", "deadline", "callback", "args", "context", "future", "active")
+
+    def __init__(self, key, deadline, callback, args, future=None):
+        self.key = key
+        self.deadline = deadline
+        self.callback = callback
+        self.args = args
+        self.context = contextvars.copy_context()
+        self.future: asyncio.Future | None = future
+        self.active = True
+
+
+class TimerService:
+    def __init__(self):
+        self._heap: list[tuple[float, int, Timer]] = []
+        self._timers: dict[Hashable, Timer] = {}
+        self._seq = itertools.count()
+        self._handle: asyncio.TimerHandle | None = None
+        self._armed_at = 0.0
+        self._tasks: set[asyncio.Task] = set()
+        self.stats = {"scheduled": 0, "fired": 0, "cancelled": 0, "replaced": 0}
+
+    def schedule(
+        self,
+        key: Hashable,
+        delay: float,
+        callback: Callable[..., Any],
+        *args,
+        replace=True,
+    ) -> bool:
+        """Runs `callback(*args)` (a function or coroutine function) in `delay` seconds.
+        Returns False if `replace` is False and `key` is already pending."""
+        return self._add(key, delay, callback, args, replace) is not None
+
+    async def sleep(self, key: Hashable, delay: float) -> bool:
+        """Sleeps for `delay` seconds.
+        Returns False if woken early by `cancel(key)` or replaced by another timer."""
+        future = asyncio.get_running_loop().create_future()
+        self._add(key, delay, None, (), True, future)
+        with tracer.span("sleep", "wait", key=str(key), delay=delay):
+            return await future
+
+    def cancel(self, key: Hashable) -> bool:
+        "Cancels a pending timer, returns True if it was pending"
+        timer = self._timers.pop(key, None)
+        if timer is None:
+            return False
+        self._deactivate(timer)
+        self.stats["cancelled"] += 1
+        return True
+
+    def pending(self, key: Hashable) -> bool:
+        return key in self._timers
+
+    def metrics(self) -> dict[str, Any]:
+        loop = asyncio.get_running_loop()
+        next_deadline = min((t.deadline for t in self._timers.values()), default=None)
+        return dict(
+            self.stats,
+            pending=len(self._timers),
+            running=len(self._tasks),
+            next_in=None if next_deadline is None else next_deadline - loop.time(),
+        )
+
+    def _add(self, key, delay, callback, args, replace, future=None) -> Timer | None:
+        old = self._timers.get(key)
+        if old is not None:
+            if not replace:
+                return None
+            self._deactivate(old)
+            self.stats["replaced"] += 1
+        loop = asyncio.get_running_loop()
+        timer = Timer(key, loop.time() + delay, callback, args, future)
+        self._timers[key] = timer
+        if len(self._heap) > 64 and len(self._heap) > 2 * len(self._timers):
+            # too many cancelled entries, drop them
+            self._heap = [e for e in self._heap if e[2].active]
+            heapq.heapify(self._heap)
+        heapq.heappush(self._heap, (timer.deadline, next(self._seq), timer))
+        self.stats["scheduled"] += 1
+        self._arm(loop)
+        return timer
+
+    @staticmethod
+    def _deactivate(timer: Timer) -> None:
+        timer.active = False
+        if timer.future is not None and not timer.future.done():
+            timer.future.set_result(False)
+
+    def _arm(self, loop: asyncio.AbstractEventLoop) -> None:
+        heap = self._heap
+        while heap and not heap[0][2].active:  # lazy deletion
+            heapq.heappop(heap)
+        if not heap:
+            if self._handle:
+                self._handle.cancel()
+                self._handle = None
+            return
+        deadline = heap[0][0]
+        if self._handle and self._armed_at <= deadline:
+            return
+        if self._handle:
+            self._handle.cancel()
+        self._armed_at = deadline
+        self._handle = loop.call_at(deadline, self._run, loop)
+
+    def _run(self, loop: asyncio.AbstractEventLoop) -> None:
+        self._handle = None
+        now = loop.time()
+        heap = self._heap
+        while heap and heap[0][0] <= now:
+            timer = heapq.heappop(heap)[2]
+            if not timer.active:
+                continue
+            timer.active = False
+            del self._timers[timer.key]
+            self.stats["fired"] += 1
+            if timer.future is not None:
+                if not timer.future.done():
+                    timer.future.set_result(True)
+                continue
+            try:
+                result = timer.context.run(timer.callback, *timer.args)
+                if asyncio.iscoroutine(result):
+                    task = timer.context.run(loop.create_task, result)
+                    self._tasks.add(task)
+                    task.add_done_callback(self._task_done)
+            except Exception:
+                print(f"Timer {timer.key} failed:")
+                traceback.print_exc()
+        self._arm(loop)
+
+    def _task_done(self, task: asyncio.Task) -> None:
+        self._tasks.discard(task)
+        if not task.cancelled() and task.exception() is not None:
+            print("Timer task failed:")
+            traceback.print_exception(task.exception())
@@ -0,0 +1,148 @@
+"""Causal tracing of commands and events.
+
+Every command or event starts a root span, anything awaited from it (plugin
+handlers, IPC calls, sleeps) opens child spans sharing the same trace id.
+The parent is propagated through a context variable, so tasks created from
+a traced coroutine stay attached to their cause.
+"""
+import contextlib
+import contextvars
+import itertools
+import json
+import os
+import time
+from collections import deque
+from typing import Any
+
+_current: contextvars.ContextVar["Span | None"] = contextvars.ContextVar(
+    "pyprland_span", default=None
+)
+_collector: contextvars.ContextVar["list[Span] | None"] = contextvars.ContextVar(
+    "pyprland_collector", default=None
+)
+_row: contextvars.ContextVar[int | None] = contextvars.ContextVar(
+    "pyprland_row", default=None
+)
+_ids = itertools.count(1)
+
+
+class _NullSpan:
+    def __enter__(self):
+        return None
+
+    def __exit__(self, *exc_info):
+        return False
+
+
+NULL_SPAN = _NullSpan()
+
+
+class Span:
+    __slots__ = (
+        "tracer",
+        "name",
+        "cat",
+        "args",
+        "id",
+        "parent_id",
+        "trace_id",
+        "row",
+        "start",
+        "end",
+        "_token",
+    )
+
+    def __init__(self, tracer: "Tracer", name: str, cat: str, args: dict[str, Any]):
+        self.tracer = tracer
+        self.name = name
+        self.cat = cat
+        self.args = args
+
+    def __enter__(self) -> "Span":
+        parent = _current.get()
+        self.id = next(_ids)
+        self.parent_id = parent.id if parent else 0
+        self.trace_id = parent.trace_id if parent else self.id
+        self.row = _row.get() or self.trace_id
+        self._token = _current.set(self)
+        self.start = time.monotonic_ns()
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        self.end = time.monotonic_ns()
+        _current.reset(self._token)
+        if exc_type is not None:
+            self.args["error"] = exc_type.__name__
+        self.tracer.record(self)
+        return False
+
+    @property
+    def duration(self) -> float:
+        "Duration in seconds"
+        return (self.end - self.start) / 1e9
+
+    def to_chrome(self, pid: int) -> dict[str, Any]:
+        return {
+            "name": self.name,
+            "cat": self.cat,
+            "ph": "X",
+            "ts": self.start / 1000,
+            "dur": (self.end - self.start) / 1000,
+            "pid": pid,
+            "tid": self.row,
+            "args": dict(self.args, span=self.id, parent=self.parent_id),
+        }
+
+
+class Tracer:
+    """Keeps the last `max_spans` finished spans in memory."""
+
+    def __init__(self, max_spans=20000):
+        self.enabled = False
+        self.spans: deque[Span] = deque(maxlen=max_spans)
+
+    def span(self, name: str, cat: str = "", **args) -> Span | _NullSpan:
+        if not self.enabled and _collector.get() is None:
+            return NULL_SPAN
+        return Span(self, name, cat, args)
+
+    def record(self, span: Span) -> None:
+        if self.enabled:
+            self.spans.append(span)
+        collected = _collector.get()
+        if collected is not None:
+            collected.append(span)
+
+    def new_row(self) -> None:
+        """Displays the next spans of this context on their own row (the trace id is kept),
+        for the tasks running concurrently with their parent or siblings."""
+        _row.set(next(_ids))
+
+    @contextlib.contextmanager
+    def collecting(self):
+        """Collects the spans finished in this context in the yielded list,
+        even if tracing is disabled."""
+        spans: list[Span] = []
+        token = _collector.set(spans)
+        try:
+            yield spans
+        finally:
+            _collector.reset(token)
+
+    def export(self, path: str) -> int:
+        """Writes the spans in the Chrome trace-event format (chrome://tracing, perfetto).
+        Returns the number of exported spans."""
+        pid = os.getpid()
+        spans = list(self.spans)
+        with open(path, "w", encoding="utf-8") as f:
+            json.dump(
+                {
+                    "traceEvents": [s.to_chrome(pid) for s in spans],
+                    "displayTimeUnit": "ms",
+                },
+                f,
+            )
+        return len(spans)
+
+
+tracer = Tracer()